@@ -0,0 +1,64 @@
+// Runtime shim linked into instrumented end-to-end workloads. Initialises
+// nxsan before the workload runs & routes C++ heap allocations through it.
+#include <cstdlib>
+#include <new>
+
+#include "runtime/nxsan_internal.h"
+#include "runtime/nxsan_runtime.h"
+
+// Tracked heap for workloads, away from the usual executable & mmap ranges.
+#define E2E_HEAP_BASE (void*)0x100000000000
+#define E2E_HEAP_SIZE (1ull << 36)
+
+// Tagged pointers can only be dereferenced where the hardware ignores the top
+// byte, so elsewhere workloads keep the libc heap & only exercise the checks.
+#ifndef E2E_TAGGED_HEAP
+#if defined(__aarch64__)
+#define E2E_TAGGED_HEAP 1
+#else
+#define E2E_TAGGED_HEAP 0
+#endif
+#endif
+
+// Runs ahead of the workload's static initialisers. The runtime is never
+// terminated, so memory still held by the C++ runtime at exit is not reported
+// as leaked.
+__attribute__((constructor(101))) static void E2eInit() {
+  if (!__nxsan_init(E2E_HEAP_BASE, E2E_HEAP_SIZE)) {
+    abort();
+  }
+}
+
+#if E2E_TAGGED_HEAP
+// Allocates from the nxsan heap once initialised, otherwise from libc.
+static void* E2eAlloc(size_t size) {
+  void* ptr = __nxsan_check_init() ? __nxsan_malloc(size ? size : 1) : malloc(size ? size : 1);
+  if (!ptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+// Frees to whichever heap the pointer came from.
+static void E2eFree(void* ptr) {
+  if (!ptr) {
+    return;
+  }
+  if (__NXSAN_EXTRACT_TAG(ptr) != 0) {
+    __nxsan_free(ptr);
+  } else {
+    free(ptr);
+  }
+}
+
+// clang-format off
+void* operator new  (size_t size) { return E2eAlloc(size); }
+void* operator new[](size_t size) { return E2eAlloc(size); }
+void* operator new  (size_t size, const std::nothrow_t&) noexcept { try { return E2eAlloc(size); } catch (...) { return nullptr; } }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { try { return E2eAlloc(size); } catch (...) { return nullptr; } }
+void operator delete  (void* ptr) noexcept { E2eFree(ptr); }
+void operator delete[](void* ptr) noexcept { E2eFree(ptr); }
+void operator delete  (void* ptr, size_t) noexcept { E2eFree(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { E2eFree(ptr); }
+// clang-format on
+#endif
@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+"""End-to-end overhead of nxsan over the bundled workloads.
+
+Each workload is compiled to IR with clang, then built twice from that IR:
+once as-is for the baseline, and once after nxsan-instrumentation-cxx, linked
+against nxsan-rt. Both are run several times. The report gives the slowdown,
+the memory overhead (peak RSS) and the number of instrumented checks.
+"""
+
+import argparse
+import json
+import os
+import re
+import shutil
+import statistics
+import subprocess
+import sys
+import time
+
+SCRIPT_DIR = os.path.dirname(os.path.abspath(__file__))
+REPO_DIR = os.path.dirname(os.path.dirname(SCRIPT_DIR))
+WORKLOAD_DIR = os.path.join(SCRIPT_DIR, "workloads")
+SHIM_SOURCE = os.path.join(SCRIPT_DIR, "nxsan_e2e_shim.cpp")
+
+STATS_KEYS = ["loads", "stores", "removed", "hoisted", "bulk", "elided", "coalesced"]
+STATS_RE = re.compile(
+    r"nxsan-stats: .* loads=(\d+) stores=(\d+) removed=(\d+) hoisted=(\d+)"
+    r" bulk=(\d+) elided=(\d+) coalesced=(\d+)")
+
+
+def fail(msg):
+    sys.exit("run_e2e: " + msg)
+
+
+def run_checked(cmd):
+    """Runs a build step, failing with its output on error."""
+    proc = subprocess.run(cmd, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                          universal_newlines=True)
+    if proc.returncode != 0:
+        fail("command failed: " + " ".join(cmd) + "\n" + proc.stdout)
+    return proc.stdout
+
+
+def find_tool(name, llvm_bin):
+    """Finds an LLVM tool in the given bin directory, falling back to PATH."""
+    if llvm_bin:
+        path = os.path.join(llvm_bin, name)
+        if os.access(path, os.X_OK):
+            return path
+    path = shutil.which(name)
+    if not path:
+        fail("could not find '%s', pass --llvm-bin" % name)
+    return path
+
+
+def measure(binary, args, runs, env):
+    """Measures median wall time & peak RSS (KiB) over the given runs."""
+    times, rss, outputs = [], [], set()
+    for _ in range(runs):
+        start = time.perf_counter()
+        pid = os.fork()
+        if pid == 0:
+            try:
+                devnull = os.open(os.devnull, os.O_WRONLY)
+                out_fd = os.open(binary + ".out", os.O_WRONLY | os.O_CREAT | os.O_TRUNC)
+                os.dup2(out_fd, 1)
+                os.dup2(devnull, 2)
+                os.execve(binary, [binary] + args, env)
+            finally:
+                os._exit(127)
+        _, status, usage = os.wait4(pid, 0)
+        elapsed = time.perf_counter() - start
+        if not os.WIFEXITED(status) or os.WEXITSTATUS(status) != 0:
+            fail("%s failed with status %d" % (binary, status))
+        with open(binary + ".out") as out:
+            outputs.add(out.read())
+        times.append(elapsed)
+        rss.append(usage.ru_maxrss)
+    if len(outputs) != 1:
+        fail("%s produced differing output between runs" % binary)
+    return statistics.median(times), max(rss), outputs.pop()
+
+
+def build_workload(src, tools, opts):
+    """Builds the baseline & instrumented binaries for a workload."""
+    name = os.path.splitext(os.path.basename(src))[0]
+    is_cxx = src.endswith(".cpp")
+    cc = tools["clang++"] if is_cxx else tools["clang"]
+    std = ["-std=c++17"] if is_cxx else []
+    base = os.path.join(opts.work_dir, name)
+
+    # Both binaries are built from the same optimised IR.
+    ir = base + ".ll"
+    run_checked([cc, "-O2", "-g0", "-S", "-emit-llvm"] + std + [src, "-o", ir])
+    run_checked([tools["clang++"], "-O2", ir, "-o", base + ".base"])
+
+    ins_ir = base + "_nxsan.ll"
+    out = run_checked([opts.instrumenter, "--stats", "--out", ins_ir] +
+                      opts.instrumenter_args + [ir])
+    match = STATS_RE.search(out)
+    if not match:
+        fail("no instrumentation statistics for %s:\n%s" % (name, out))
+    stats = dict(zip(STATS_KEYS, map(int, match.groups())))
+    run_checked([tools["clang++"], "-O2", ins_ir, tools["shim"], opts.runtime,
+                 "-lpthread", "-ldl", "-o", base + ".nxsan"])
+    return name, base, stats
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--instrumenter", required=True,
+                        help="path to nxsan-instrumentation-cxx")
+    parser.add_argument("--runtime", required=True, help="path to libnxsan-rt.a")
+    parser.add_argument("--llvm-bin", help="directory holding clang & clang++")
+    parser.add_argument("--work-dir", default="nxsan-e2e",
+                        help="directory for intermediate files & binaries")
+    parser.add_argument("--runs", type=int, default=5,
+                        help="runs of each binary, the median time is reported")
+    parser.add_argument("--scale", type=int, default=1, help="workload size multiplier")
+    parser.add_argument("--filter", default="", help="only run workloads containing this")
+    parser.add_argument("--instrumenter-arg", dest="instrumenter_args", action="append",
+                        default=[], help="extra argument for the instrumenter (repeatable)")
+    parser.add_argument("--options", default=os.environ.get("NXSAN_OPTIONS", ""),
+                        help="NXSAN_OPTIONS for instrumented runs")
+    parser.add_argument("--json", help="write results as JSON to this path")
+    opts = parser.parse_args()
+
+    os.makedirs(opts.work_dir, exist_ok=True)
+    opts.work_dir = os.path.abspath(opts.work_dir)
+    tools = {name: find_tool(name, opts.llvm_bin) for name in ("clang", "clang++")}
+    tools["shim"] = os.path.join(opts.work_dir, "nxsan_e2e_shim.o")
+    run_checked([tools["clang++"], "-O2", "-std=c++17", "-I",
+                 os.path.join(REPO_DIR, "include"), "-c", SHIM_SOURCE, "-o", tools["shim"]])
+
+    base_env = dict(os.environ)
+    base_env.pop("NXSAN_OPTIONS", None)
+    nxsan_env = dict(base_env, NXSAN_OPTIONS=opts.options)
+    args = [str(opts.scale)]
+
+    results = []
+    sources = sorted(f for f in os.listdir(WORKLOAD_DIR) if f.endswith((".c", ".cpp")))
+    for src in sources:
+        if opts.filter not in src:
+            continue
+        name, base, stats = build_workload(os.path.join(WORKLOAD_DIR, src), tools, opts)
+        base_time, base_rss, base_out = measure(base + ".base", args, opts.runs, base_env)
+        nxsan_time, nxsan_rss, nxsan_out = measure(base + ".nxsan", args, opts.runs, nxsan_env)
+        if base_out != nxsan_out:
+            fail("%s output differs when instrumented" % name)
+        results.append(dict(name=name, base_time=base_time, nxsan_time=nxsan_time,
+                            slowdown=nxsan_time / base_time, base_rss_kib=base_rss,
+                            nxsan_rss_kib=nxsan_rss, memory_overhead=nxsan_rss / base_rss,
+                            **stats))
+
+    header = "%-10s %9s %9s %8s %10s %10s %8s" % (
+        "workload", "base(s)", "nxsan(s)", "slowdown", "base(MiB)", "nxsan(MiB)", "mem")
+    header += "".join(" %9s" % key for key in STATS_KEYS)
+    print(header)
+    print("-" * len(header))
+    for r in results:
+        print("%-10s %9.3f %9.3f %7.2fx %10.1f %10.1f %7.2fx" % (
+            r["name"], r["base_time"], r["nxsan_time"], r["slowdown"],
+            r["base_rss_kib"] / 1024, r["nxsan_rss_kib"] / 1024, r["memory_overhead"]) +
+            "".join(" %9d" % r[key] for key in STATS_KEYS))
+    if results:
+        print("geomean slowdown: %.2fx, memory overhead: %.2fx" % (
+            statistics.geometric_mean(r["slowdown"] for r in results),
+            statistics.geometric_mean(r["memory_overhead"] for r in results)))
+
+    if opts.json:
+        with open(opts.json, "w") as out:
+            json.dump(dict(instrumenter_args=opts.instrumenter_args, options=opts.options,
+                           scale=opts.scale, runs=opts.runs, workloads=results),
+                      out, indent=2)
+
+
+if __name__ == "__main__":
+    main()
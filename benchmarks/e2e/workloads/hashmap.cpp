@@ -0,0 +1,82 @@
+// Hash map workload: inserts, lookups & erases on both an open addressing
+// table and std::unordered_map.
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <unordered_map>
+#include <vector>
+
+// Linear probing table of 64-bit keys & values. Key 0 marks an empty slot.
+class ProbingMap {
+public:
+  explicit ProbingMap(size_t capacity) : m_keys(capacity, 0), m_values(capacity, 0), m_mask(capacity - 1) {}
+
+  void Insert(uint64_t key, uint64_t value) {
+    size_t slot = Hash(key) & m_mask;
+    while (m_keys[slot] != 0 && m_keys[slot] != key) {
+      slot = (slot + 1) & m_mask;
+    }
+    m_keys[slot] = key;
+    m_values[slot] = value;
+  }
+
+  const uint64_t* Find(uint64_t key) const {
+    size_t slot = Hash(key) & m_mask;
+    while (m_keys[slot] != 0) {
+      if (m_keys[slot] == key) {
+        return &m_values[slot];
+      }
+      slot = (slot + 1) & m_mask;
+    }
+    return nullptr;
+  }
+
+private:
+  static uint64_t Hash(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDull;
+    return key ^ (key >> 33);
+  }
+
+  std::vector<uint64_t> m_keys, m_values;
+  size_t m_mask;
+};
+
+int main(int argc, char** argv) {
+  size_t scale = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1;
+  size_t numKeys = 200000 * scale;
+  uint64_t checksum = 0;
+
+  size_t capacity = 1;
+  while (capacity < numKeys * 2) {
+    capacity <<= 1;
+  }
+  ProbingMap probing(capacity);
+  std::unordered_map<uint64_t, uint64_t> chained;
+  for (size_t i = 1; i <= numKeys; i++) {
+    uint64_t key = i * 0x9E3779B97F4A7C15ull;
+    probing.Insert(key, i);
+    chained[key] = i;
+  }
+
+  for (int round = 0; round < 8; round++) {
+    for (size_t i = 1; i <= numKeys * 2; i++) {
+      uint64_t key = i * 0x9E3779B97F4A7C15ull;
+      if (const uint64_t* value = probing.Find(key)) {
+        checksum += *value;
+      }
+      auto it = chained.find(key);
+      if (it != chained.end()) {
+        checksum += it->second * 3;
+      }
+    }
+  }
+
+  for (size_t i = 1; i <= numKeys; i += 2) {
+    chained.erase(i * 0x9E3779B97F4A7C15ull);
+  }
+  checksum += chained.size();
+
+  printf("%llu\n", (unsigned long long)checksum);
+  return 0;
+}
@@ -0,0 +1,68 @@
+// Matrix workload: blocked multiply, transpose & a stencil over heap
+// allocated row-major matrices.
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BLOCK 32
+
+static void multiply(const double* a, const double* b, double* c, size_t n) {
+  for (size_t ii = 0; ii < n; ii += BLOCK) {
+    for (size_t kk = 0; kk < n; kk += BLOCK) {
+      for (size_t i = ii; i < ii + BLOCK && i < n; i++) {
+        for (size_t k = kk; k < kk + BLOCK && k < n; k++) {
+          double aik = a[i * n + k];
+          for (size_t j = 0; j < n; j++) {
+            c[i * n + j] += aik * b[k * n + j];
+          }
+        }
+      }
+    }
+  }
+}
+
+static void transpose(const double* a, double* t, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    for (size_t j = 0; j < n; j++) {
+      t[j * n + i] = a[i * n + j];
+    }
+  }
+}
+
+static void stencil(const double* a, double* out, size_t n) {
+  for (size_t i = 1; i + 1 < n; i++) {
+    for (size_t j = 1; j + 1 < n; j++) {
+      out[i * n + j] = 0.2 * (a[i * n + j] + a[(i - 1) * n + j] + a[(i + 1) * n + j] +
+                              a[i * n + j - 1] + a[i * n + j + 1]);
+    }
+  }
+}
+
+int main(int argc, char** argv) {
+  size_t scale = argc > 1 ? strtoul(argv[1], NULL, 10) : 1;
+  size_t n = 512 * scale;
+  double* a = malloc(n * n * sizeof(double));
+  double* b = malloc(n * n * sizeof(double));
+  double* c = calloc(n * n, sizeof(double));
+  for (size_t i = 0; i < n * n; i++) {
+    a[i] = (double)(i % 17) / 16.0;
+    b[i] = (double)(i % 13) / 12.0;
+  }
+
+  multiply(a, b, c, n);
+  transpose(c, b, n);
+  for (int round = 0; round < 32; round++) {
+    stencil(b, a, n);
+    stencil(a, b, n);
+  }
+
+  double checksum = 0;
+  for (size_t i = 0; i < n * n; i += 7) {
+    checksum += b[i];
+  }
+  printf("%.6f\n", checksum);
+  free(a);
+  free(b);
+  free(c);
+  return 0;
+}
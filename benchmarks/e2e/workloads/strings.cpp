@@ -0,0 +1,55 @@
+// String processing workload: building, splitting, searching & sorting
+// std::strings.
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+int main(int argc, char** argv) {
+  size_t scale = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1;
+  size_t numWords = 200000 * scale;
+  uint64_t checksum = 0;
+
+  // Build a text of pseudo-random words.
+  std::string text;
+  uint32_t state = 2463534242u;
+  for (size_t i = 0; i < numWords; i++) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    size_t len = 3 + state % 9;
+    for (size_t j = 0; j < len; j++) {
+      text += (char)('a' + (state >> (j * 2)) % 26);
+    }
+    text += ' ';
+  }
+
+  // Split into words.
+  std::vector<std::string> words;
+  size_t start = 0;
+  for (size_t pos = text.find(' '); pos != std::string::npos; pos = text.find(' ', start)) {
+    words.emplace_back(text, start, pos - start);
+    start = pos + 1;
+  }
+
+  // Search, transform & sort.
+  for (const char* needle : {"abc", "zz", "qua", "ee"}) {
+    for (size_t pos = text.find(needle); pos != std::string::npos; pos = text.find(needle, pos + 1)) {
+      checksum += pos;
+    }
+  }
+  for (std::string& word : words) {
+    std::reverse(word.begin(), word.end());
+    word[0] = (char)(word[0] - 'a' + 'A');
+  }
+  std::sort(words.begin(), words.end());
+  words.erase(std::unique(words.begin(), words.end()), words.end());
+  for (const std::string& word : words) {
+    checksum = checksum * 31 + word.size() + (uint8_t)word.back();
+  }
+
+  printf("%llu\n", (unsigned long long)checksum);
+  return 0;
+}
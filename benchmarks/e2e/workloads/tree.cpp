@@ -0,0 +1,76 @@
+// Tree workload: an unbalanced binary search tree of heap nodes, plus
+// std::map inserts, range scans & erases.
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+
+struct Node {
+  uint64_t key;
+  Node* left;
+  Node* right;
+};
+
+static Node* Insert(Node* root, uint64_t key) {
+  Node** link = &root;
+  while (*link) {
+    link = key < (*link)->key ? &(*link)->left : &(*link)->right;
+  }
+  *link = new Node{key, nullptr, nullptr};
+  return root;
+}
+
+static uint64_t Sum(const Node* node) {
+  uint64_t sum = 0;
+  while (node) {
+    sum += node->key + Sum(node->left);
+    node = node->right;
+  }
+  return sum;
+}
+
+static void Destroy(Node* node) {
+  while (node) {
+    Destroy(node->left);
+    Node* right = node->right;
+    delete node;
+    node = right;
+  }
+}
+
+int main(int argc, char** argv) {
+  size_t scale = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1;
+  size_t numKeys = 100000 * scale;
+  uint64_t checksum = 0;
+
+  // Pseudo-random keys keep the tree shallow on average.
+  Node* root = nullptr;
+  uint64_t state = 88172645463325252ull;
+  for (size_t i = 0; i < numKeys; i++) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    root = Insert(root, state);
+  }
+  for (int round = 0; round < 4; round++) {
+    checksum += Sum(root);
+  }
+  Destroy(root);
+
+  std::map<uint64_t, uint64_t> ordered;
+  for (size_t i = 0; i < numKeys; i++) {
+    ordered[(i * 7919) % numKeys] = i;
+  }
+  for (int round = 0; round < 4; round++) {
+    for (auto it = ordered.lower_bound(numKeys / 4); it != ordered.end() && it->first < numKeys / 2; ++it) {
+      checksum += it->second;
+    }
+  }
+  for (size_t i = 0; i < numKeys; i += 3) {
+    ordered.erase(i);
+  }
+  checksum += ordered.size();
+
+  printf("%llu\n", (unsigned long long)checksum);
+  return 0;
+}
@@ -0,0 +1,67 @@
+#include <benchmark/benchmark.h>
+#include <vector>
+
+#include "runtime/nxsan_runtime.h"
+#include "runtime/nxsan_internal.h"
+
+#define TRACK_REGION_BASE (void*)0x100000000000
+#define TRACK_REGION_SIZE (1ull << 36)
+
+// Number of allocations held at once by the batched benchmarks.
+#define BATCH_SIZE 256
+
+static void NxsanSetup(const benchmark::State&) { __nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE); }
+static void NxsanTeardown(const benchmark::State&) { __nxsan_terminate(); }
+
+// A single allocation freed straight away, across size classes & the large
+// allocation path.
+static void BM_MallocFree(benchmark::State& state) {
+  size_t size = state.range(0);
+  for (auto _ : state) {
+    void* pt = __nxsan_malloc(size);
+    benchmark::DoNotOptimize(pt);
+    __nxsan_free(pt);
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_MallocFree)->Setup(NxsanSetup)->Teardown(NxsanTeardown)->RangeMultiplier(4)->Range(16, 1 << 22);
+
+// A batch of allocations live at once, then freed in allocation order.
+static void BM_MallocFreeBatch(benchmark::State& state) {
+  size_t size = state.range(0);
+  std::vector<void*> pts(BATCH_SIZE);
+  for (auto _ : state) {
+    for (void*& pt : pts) {
+      pt = __nxsan_malloc(size);
+    }
+    benchmark::DoNotOptimize(pts.data());
+    for (void* pt : pts) {
+      __nxsan_free(pt);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * BATCH_SIZE);
+}
+BENCHMARK(BM_MallocFreeBatch)->Setup(NxsanSetup)->Teardown(NxsanTeardown)->RangeMultiplier(8)->Range(16, 1 << 15);
+
+// Batched allocation from many threads at once, to measure scaling.
+static void BM_MallocFreeThreads(benchmark::State& state) {
+  size_t size = state.range(0);
+  std::vector<void*> pts(BATCH_SIZE);
+  for (auto _ : state) {
+    for (void*& pt : pts) {
+      pt = __nxsan_malloc(size);
+    }
+    benchmark::DoNotOptimize(pts.data());
+    for (void* pt : pts) {
+      __nxsan_free(pt);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * BATCH_SIZE);
+}
+BENCHMARK(BM_MallocFreeThreads)
+    ->Setup(NxsanSetup)
+    ->Teardown(NxsanTeardown)
+    ->Arg(64)
+    ->Arg(4096)
+    ->ThreadRange(1, 16)
+    ->UseRealTime();
@@ -0,0 +1,69 @@
+#include <benchmark/benchmark.h>
+
+#define __NXSAN_OUTLINE_REPORTING
+#include "runtime/nxsan_runtime.h"
+#include "runtime/nxsan_internal.h"
+
+#define TRACK_REGION_BASE (void*)0x100000000000
+#define TRACK_REGION_SIZE (1ull << 36)
+
+static void NxsanSetup(const benchmark::State&) { __nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE); }
+static void NxsanTeardown(const benchmark::State&) { __nxsan_terminate(); }
+
+// Tagged pointer whose shadow tag matches, the common case.
+static void BM_ReportLoadTagged(benchmark::State& state) {
+  void* pt = __nxsan_malloc(64);
+  for (auto _ : state) {
+    __nxsan_report_load64(pt);
+    benchmark::ClobberMemory();
+  }
+  __nxsan_free(pt);
+}
+BENCHMARK(BM_ReportLoadTagged)->Setup(NxsanSetup)->Teardown(NxsanTeardown);
+
+// Untagged pointer outside of the tracked heap, such as a stack address.
+static void BM_ReportLoadUntagged(benchmark::State& state) {
+  uint64_t local = 0;
+  for (auto _ : state) {
+    __nxsan_report_load64(&local);
+    benchmark::ClobberMemory();
+  }
+}
+BENCHMARK(BM_ReportLoadUntagged)->Setup(NxsanSetup)->Teardown(NxsanTeardown);
+
+// Access within a short granule, which reads the tag from the granule itself.
+static void BM_ReportLoadShortGranule(benchmark::State& state) {
+  void* pt = __nxsan_malloc(__NXSAN_TAG_GRANULARITY_BYTES / 2);
+  for (auto _ : state) {
+    __nxsan_report_load32(pt);
+    benchmark::ClobberMemory();
+  }
+  __nxsan_free(pt);
+}
+BENCHMARK(BM_ReportLoadShortGranule)->Setup(NxsanSetup)->Teardown(NxsanTeardown);
+
+// Tagged accesses with only 1 in N verified.
+static void BM_ReportLoadSampled(benchmark::State& state) {
+  __nxsan_set_sample_rate(state.range(0));
+  void* pt = __nxsan_malloc(64);
+  for (auto _ : state) {
+    __nxsan_report_load64(pt);
+    benchmark::ClobberMemory();
+  }
+  __nxsan_free(pt);
+  __nxsan_set_sample_rate(1);
+}
+BENCHMARK(BM_ReportLoadSampled)->Setup(NxsanSetup)->Teardown(NxsanTeardown)->Arg(10)->Arg(100);
+
+// Range checks over a whole allocation, ending in a short granule.
+static void BM_ReportLoadRange(benchmark::State& state) {
+  size_t size = state.range(0) - 1;
+  void* pt = __nxsan_malloc(size);
+  for (auto _ : state) {
+    __nxsan_report_load_range(pt, size);
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+  __nxsan_free(pt);
+}
+BENCHMARK(BM_ReportLoadRange)->Setup(NxsanSetup)->Teardown(NxsanTeardown)->RangeMultiplier(8)->Range(32, 1 << 20);
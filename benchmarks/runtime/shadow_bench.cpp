@@ -0,0 +1,27 @@
+#include <benchmark/benchmark.h>
+#include <vector>
+
+#include "runtime/nxsan_internal.h"
+
+static void KernelSetup(const benchmark::State&) { __nxsan_init_shadow_kernels(); }
+
+// Bulk shadow fills, as done when tagging & clearing allocations.
+static void BM_ShadowFill(benchmark::State& state) {
+  std::vector<uint8_t> shadow(state.range(0));
+  for (auto _ : state) {
+    __nxsan_shadow_fill(shadow.data(), 0xAB, shadow.size());
+    benchmark::ClobberMemory();
+  }
+  state.SetBytesProcessed(state.iterations() * shadow.size());
+}
+BENCHMARK(BM_ShadowFill)->Setup(KernelSetup)->RangeMultiplier(8)->Range(8, 1 << 18);
+
+// Bulk shadow scans with no mismatch, as done by range checks.
+static void BM_ShadowFindMismatch(benchmark::State& state) {
+  std::vector<uint8_t> shadow(state.range(0), 0xAB);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(__nxsan_shadow_find_mismatch(shadow.data(), 0xAB, shadow.size()));
+  }
+  state.SetBytesProcessed(state.iterations() * shadow.size());
+}
+BENCHMARK(BM_ShadowFindMismatch)->Setup(KernelSetup)->RangeMultiplier(8)->Range(8, 1 << 18);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <unordered_set>
+#include <vector>
+
+namespace nxsan {
+
+// Transform which merges the checks of loads (or stores) within a basic block
+// at constant offsets from the same base pointer, such as the fields of a
+// struct copy or the body of an unrolled loop, into a single range check over
+// the span they cover. The range check is emitted before the first access of
+// the group, so groups end at any instruction which may free memory or may not
+// pass execution on to the next instruction.
+class AccessCoalescer {
+public:
+  AccessCoalescer(llvm::Function &func, const llvm::DataLayout &layout);
+
+  // Coalesces checks for the given accesses where possible, emitting calls to
+  // the given range instruments.
+  void Run(const std::vector<llvm::Instruction *> &accesses,
+           llvm::FunctionCallee loadRange, llvm::FunctionCallee storeRange);
+
+  // Returns whether the check for the given access has been coalesced.
+  bool IsCoalesced(llvm::Instruction *inst) const {
+    return m_coalesced.count(inst) > 0;
+  }
+
+  // Returns the number of checks which have been coalesced.
+  uint64_t GetNumCoalesced() const { return m_coalesced.size(); }
+
+private:
+  // Accesses of the same kind from the same base, covering the byte range
+  // [low, high) relative to it.
+  struct Group {
+    llvm::Value *base;
+    bool isStore;
+    int64_t low;
+    int64_t high;
+    std::vector<llvm::Instruction *> members;
+  };
+
+  void ProcessBlock(llvm::BasicBlock &bb, llvm::FunctionCallee loadRange,
+                    llvm::FunctionCallee storeRange);
+  void FlushGroup(const Group &group, llvm::FunctionCallee loadRange,
+                  llvm::FunctionCallee storeRange);
+
+  llvm::Function &m_func;
+  const llvm::DataLayout &m_layout;
+  std::unordered_set<llvm::Instruction *> m_accesses;
+  std::unordered_set<llvm::Instruction *> m_coalesced;
+};
+
+} // namespace nxsan
@@ -1,52 +1,91 @@
 #pragma once
 
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Module.h>
 #include <memory>
 #include <string>
 #include <unordered_map>
 
+#include "instrumentation/InstrumenterOptions.hpp"
 #include "utils/NxsResult.hpp"
 
 namespace nxsan {
 
 // Return result from instrumentation.
 struct InstrumentedIr {
-  std::string ir;
   uint64_t numLoads;
   uint64_t numStores;
+  uint64_t numRemovedChecks;
+  uint64_t numHoistedChecks;
+  uint64_t numBulkOps;
+  uint64_t numElidedChecks;
+  uint64_t numCoalescedChecks;
+
+  // Whether any function body was changed (beyond declaring instruments).
+  bool modified;
 };
 
-// Size of each instrument for load/store.
-enum class InstrumentSize { A8, A16, A32, A64 };
+// Size of each instrument for load/store. Accesses of any other size use the
+// sized instrument, which takes the size as an argument.
+enum class InstrumentSize { A8, A16, A32, A64, A128, A256, A512, Sized };
 
-// Type of instrument.
-enum class InstrumentMode { Load, Store };
+// Type of instrument. Atomic read-modify-writes & compare-exchanges both load
+// and store, but are verified with a single check.
+enum class InstrumentMode { Load, Store, ReadModifyWrite };
 
 // Class for reading & instrumenting pointer accesses within
 // LLVM IR for sanitization.
 class AccessInstrumenter {
 public:
-  AccessInstrumenter(const std::string &llvmIrPath);
+  AccessInstrumenter(const InstrumenterOptions &options = {});
+
+  // Generates instrumented IR from the given LLVM IR file (textual or
+  // bitcode), streaming it to the given output path in the given format.
+  NxsResult<InstrumentedIr, std::string> GenerateIR(const std::string &inPath,
+                                                    const std::string &outPath,
+                                                    IrFormat format);
 
-  // Generates instrumented IR from the source LLVM IR file.
-  NxsResult<InstrumentedIr, std::string> GenerateIR();
+  // Instruments all accesses within the given module in place.
+  InstrumentedIr InstrumentModule(llvm::Module &mod);
 
 private:
+  void InstrumentFunction(llvm::Function &func);
   void InstrumentInstr(llvm::Instruction &inst);
+  void InstrumentBulkOp(llvm::CallBase &call);
+  void InstrumentInline(llvm::Instruction &inst, llvm::Value *addr,
+                        llvm::FunctionCallee slowPath);
+  llvm::Instruction *InsertSampleGate(llvm::Instruction &inst);
+  llvm::Instruction *InsertSampleRearm(llvm::Instruction &inst);
 
   llvm::Value *GetPointerOperand(llvm::Instruction &instr);
   std::optional<InstrumentMode> GetInstrumentMode(llvm::Instruction &instr);
+  bool IsBulkOp(llvm::Instruction &instr);
+  bool IsNonHeapAccess(llvm::Instruction &instr);
+  bool IsNonHeapPointer(const llvm::Value *ptr);
   InstrumentSize GetInstrumentSize(llvm::Instruction &instr);
   llvm::Type *GetLoadStoreType(const llvm::Value *I);
+  llvm::Value *CreateAccessSize(llvm::IRBuilder<> &builder,
+                                llvm::Instruction &instr);
 
   llvm::FunctionCallee GetInstrument(InstrumentMode mode, InstrumentSize size);
   void DeclareInstruments(llvm::LLVMContext &ctx);
+  void DeclareShadowGlobals(llvm::LLVMContext &ctx);
+  void DeclareSampleGlobals(llvm::LLVMContext &ctx);
 
-  std::unique_ptr<llvm::Module> m_mod;
+  llvm::Module *m_mod;
+  std::unique_ptr<llvm::TargetLibraryInfoImpl> m_libInfo;
   std::unordered_map<InstrumentSize, llvm::FunctionCallee> m_loadCallees;
   std::unordered_map<InstrumentSize, llvm::FunctionCallee> m_storeCallees;
-  std::string m_filePath;
-  uint64_t m_numLoads, m_numStores;
+  std::unordered_map<InstrumentSize, llvm::FunctionCallee> m_rmwCallees;
+  llvm::FunctionCallee m_loadRangeCallee, m_storeRangeCallee;
+  llvm::FunctionCallee m_memcpyCallee, m_memmoveCallee, m_memsetCallee;
+  llvm::Constant *m_shadowGlobal, *m_heapBaseGlobal, *m_shadowSizeGlobal;
+  llvm::Constant *m_sampleCountdownGlobal, *m_flagsGlobal;
+  InstrumenterOptions m_options;
+  uint64_t m_numLoads, m_numStores, m_numRemovedChecks, m_numHoistedChecks;
+  uint64_t m_numBulkOps, m_numElidedChecks, m_numCoalescedChecks;
+  bool m_modified;
 };
 
 } // namespace nxsan
@@ -4,6 +4,7 @@
 #include <string>
 #include <vector>
 
+#include "instrumentation/InstrumenterOptions.hpp"
 #include "utils/NxsResult.hpp"
 
 namespace nxsan {
@@ -24,14 +25,30 @@ public:
   // Returns whether the manual has been requested.
   bool IsHelpRequested() const { return m_printHelp; }
 
+  // Returns whether per-file instrumentation statistics have been requested.
+  bool IsStatsRequested() const { return m_printStats; }
+
+  // Returns the options to instrument input files with.
+  const InstrumenterOptions &GetInstrumenterOptions() const {
+    return m_options;
+  }
+
+  // Returns the number of input files to instrument in parallel.
+  size_t GetNumJobs() const { return m_numJobs; }
+
   // Returns the output file format, if configured.
   std::string GetOutFileFormat() const {
-    return m_outFile.value_or("{}_nxsan.ll");
+    return m_outFile.value_or(m_irFormat == IrFormat::Bitcode ? "{}_nxsan.bc"
+                                                              : "{}_nxsan.ll");
   }
 
+  // Returns the IR format to write a given output file in.
+  // Based on the configured format if any, otherwise the output extension.
+  IrFormat GetOutIrFormat(const std::string &outFileName) const;
+
   // Returns the output file name for a given input file.
   // Based on the output file format in the command line arguments.
-  std::string GetOutFileName(const std::string& inFileName);
+  std::string GetOutFileName(const std::string& inFileName) const;
 
 private:
   // Parses the given option out. Returns whether the next parameter was
@@ -39,9 +56,13 @@ private:
   NxsResult<bool, std::string> ParseOpt(std::string opt,
                                         std::optional<std::string> next);
 
-  bool m_printHelp;
+  bool m_printHelp = false;
+  bool m_printStats = false;
   std::vector<std::string> m_inputFiles;
   std::optional<std::string> m_outFile;
+  size_t m_numJobs = 1;
+  std::optional<IrFormat> m_irFormat;
+  InstrumenterOptions m_options;
 };
 
 } // namespace nxsan
@@ -0,0 +1,43 @@
+#pragma once
+
+namespace nxsan {
+
+// Format of LLVM IR written by the instrumenter.
+enum class IrFormat { Text, Bitcode };
+
+// Options controlling how the access instrumenter emits checks.
+struct InstrumenterOptions {
+  // Emits the shadow tag comparison directly as IR, only calling out to the
+  // runtime on a mismatch, short granule or untracked pointer.
+  bool inlineChecks = false;
+
+  // Emits the runtime's per-thread sampling countdown inline before each
+  // fixed size check, so accesses skipped by sampling never call into the
+  // runtime. The rate itself is set at runtime through NXSAN_OPTIONS. Range
+  // checks hoisted out of loops are never sampled.
+  bool sampleChecks = false;
+
+  // Drops checks of accesses whose underlying object is a stack object or a
+  // global, as pointers to those never carry a tag.
+  bool elideNonHeapChecks = true;
+
+  // Drops checks which are dominated by an equal or wider check on the same
+  // pointer, with no call which may free memory in between.
+  bool eliminateRedundantChecks = true;
+
+  // Replaces per-iteration checks of affine accesses in counted loops with a
+  // single range check in the loop preheader.
+  bool hoistLoopChecks = true;
+
+  // Replaces the checks of loads (or stores) within a basic block at constant
+  // offsets from the same pointer with a single range check over their span.
+  // Has no effect alongside inline or sampled checks.
+  bool coalesceChecks = true;
+
+  // Replaces memcpy, memmove & memset (both the LLVM intrinsics and direct
+  // libc calls) with runtime wrappers which verify the whole source &
+  // destination ranges before performing the operation.
+  bool instrumentBulkOps = true;
+};
+
+} // namespace nxsan
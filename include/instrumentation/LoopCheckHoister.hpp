@@ -0,0 +1,62 @@
+#pragma once
+
+#include <llvm/Analysis/AssumptionCache.h>
+#include <llvm/Analysis/LoopInfo.h>
+#include <llvm/Analysis/ScalarEvolution.h>
+#include <llvm/Analysis/TargetLibraryInfo.h>
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <set>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace nxsan {
+
+// Transform which replaces the per-iteration checks of affine accesses within
+// counted loops with a single range check in the loop preheader, covering
+// every address the access touches over the lifetime of the loop.
+class LoopCheckHoister {
+public:
+  LoopCheckHoister(llvm::Function &func, const llvm::DataLayout &layout);
+
+  // Hoists checks for the given accesses where possible, emitting calls to the
+  // given range instruments in loop preheaders.
+  void Run(const std::vector<llvm::Instruction *> &accesses,
+           llvm::FunctionCallee loadRange, llvm::FunctionCallee storeRange);
+
+  // Returns whether the check for the given access has been hoisted.
+  bool IsHoisted(llvm::Instruction *inst) const {
+    return m_hoisted.count(inst) > 0;
+  }
+
+  // Returns the number of per-iteration checks which have been hoisted.
+  uint64_t GetNumHoisted() const { return m_hoisted.size(); }
+
+private:
+  // A range check which has been emitted within a loop preheader.
+  using RangeCheck =
+      std::tuple<const llvm::Loop *, const llvm::SCEV *, const llvm::SCEV *,
+                 bool>;
+
+  bool TryHoist(llvm::Instruction *inst, llvm::FunctionCallee loadRange,
+                llvm::FunctionCallee storeRange);
+  bool LoopMayFree(llvm::Loop *loop);
+
+  llvm::Function &m_func;
+  const llvm::DataLayout &m_layout;
+  llvm::TargetLibraryInfoImpl m_tlii;
+  llvm::TargetLibraryInfo m_tli;
+  llvm::AssumptionCache m_assumptions;
+  llvm::DominatorTree m_domTree;
+  llvm::LoopInfo m_loopInfo;
+  llvm::ScalarEvolution m_scev;
+  std::unordered_map<llvm::Loop *, bool> m_loopMayFree;
+  std::set<RangeCheck> m_emitted;
+  std::unordered_set<llvm::Instruction *> m_hoisted;
+};
+
+} // namespace nxsan
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <llvm/IR/Module.h>
+#include <llvm/IR/PassManager.h>
+
+#include "instrumentation/InstrumenterOptions.hpp"
+
+namespace nxsan {
+
+// New pass manager module pass instrumenting all memory accesses within a
+// module for sanitization.
+class NxsanPass : public llvm::PassInfoMixin<NxsanPass> {
+public:
+  NxsanPass(const InstrumenterOptions &options = {});
+
+  llvm::PreservedAnalyses run(llvm::Module &mod,
+                              llvm::ModuleAnalysisManager &mam);
+
+  // Instrumentation must run even for optnone functions.
+  static bool isRequired() { return true; }
+
+private:
+  InstrumenterOptions m_options;
+};
+
+} // namespace nxsan
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/Dominators.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <unordered_set>
+#include <vector>
+
+namespace nxsan {
+
+// Analysis for finding memory access checks that are made redundant by a
+// dominating check covering the same (or a wider) byte range from the same
+// base pointer, with no call that may free memory in between.
+class RedundantCheckEliminator {
+public:
+  RedundantCheckEliminator(llvm::Function &func,
+                           const llvm::DataLayout &layout);
+
+  // Runs the analysis over the given accesses, which must all be within the
+  // function this analysis was created for.
+  void Run(const std::vector<llvm::Instruction *> &accesses);
+
+  // Returns whether the check for the given access can be dropped.
+  bool IsRedundant(llvm::Instruction *inst) const {
+    return m_redundant.count(inst) > 0;
+  }
+
+  // Returns the number of checks found to be redundant.
+  uint64_t GetNumRedundant() const { return m_redundant.size(); }
+
+  // Returns whether the given instruction is a call which may free memory.
+  static bool MayFree(llvm::Instruction &inst);
+
+private:
+  // A check which has been performed, and is valid until memory may be freed.
+  struct AvailableCheck {
+    const llvm::Value *base;
+    int64_t offset;
+    uint64_t size;
+  };
+
+  void ProcessBlock(llvm::BasicBlock &bb,
+                    std::vector<AvailableCheck> &available);
+  bool PathMayFree(llvm::BasicBlock *from, llvm::BasicBlock *to);
+  bool BlockMayFree(llvm::BasicBlock &bb);
+
+  llvm::Function &m_func;
+  const llvm::DataLayout &m_layout;
+  llvm::DominatorTree m_domTree;
+  std::unordered_set<llvm::Instruction *> m_accesses;
+  std::unordered_set<llvm::Instruction *> m_redundant;
+};
+
+} // namespace nxsan
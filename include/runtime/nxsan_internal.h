@@ -6,7 +6,6 @@
 // Author: c272
 
 #include <cstddef>
-#include <random>
 #include <stdint.h>
 #include <string>
 
@@ -26,11 +25,11 @@ static_assert(__NXSAN_TAG_SIZE_BITS == 4 || __NXSAN_TAG_SIZE_BITS == 8,
 
 // Macro for manipulating the tag with a 64-bit pointer.
 #define __NXSAN_EXTRACT_TAG(x)                                                 \
-  (uint8_t)(((uint64_t)x & __NXSAN_TAG_MASK) >> (64 - __NXSAN_TAG_SIZE_BITS))
+  (uint8_t)(((uint64_t)(x) & __NXSAN_TAG_MASK) >> (64 - __NXSAN_TAG_SIZE_BITS))
 #define __NXSAN_EMPLACE_TAG(x, tag)                                            \
-  (void *)(((uint64_t)x & __NXSAN_INVERSE_TAG_MASK) |                          \
-           ((uint64_t)tag << (64 - __NXSAN_TAG_SIZE_BITS)))
-#define __NXSAN_REMOVE_TAG(x) (void *)((uint64_t)x & __NXSAN_INVERSE_TAG_MASK)
+  (void *)(((uint64_t)(x) & __NXSAN_INVERSE_TAG_MASK) |                        \
+           ((uint64_t)(tag) << (64 - __NXSAN_TAG_SIZE_BITS)))
+#define __NXSAN_REMOVE_TAG(x) (void *)((uint64_t)(x) & __NXSAN_INVERSE_TAG_MASK)
 
 // Alignment (in bits) of allocated tracked memory.
 #define __NXSAN_TAG_GRANULARITY_BYTES 16
@@ -52,23 +51,19 @@ static_assert(__NXSAN_TAG_GRANULARITY_BYTES >= alignof(std::max_align_t),
 #define __NXSAN_PTR_FREED       6
 // clang-format on
 
-// Internal allocation functions.
-// Note: Allocation functions set for the below defines should be guaranteed to
-// allocate within the tracked heap memory region, otherwise undefined behavior will occur.
-#ifndef __NXSAN_INTERNAL_ALIGNED_ALLOC
-#define __NXSAN_INTERNAL_ALIGNED_ALLOC std::aligned_alloc
-#endif
-#ifndef __NXSAN_INTERNAL_CALLOC
-#define __NXSAN_INTERNAL_CALLOC std::calloc
-#endif
-#ifndef __NXSAN_INTERNAL_FREE
-#define __NXSAN_INTERNAL_FREE std::free
-#endif
-
 /**************************
  * Global shadow storage. *
  **************************/
 
+// Concurrency: the globals below are only written by __nxsan_init and
+// __nxsan_terminate, which must not run concurrently with any other runtime
+// call. Each shadow byte is owned by the allocation covering its granule, and
+// is only written by the thread allocating or freeing that allocation (the
+// allocator hands off ownership). Other threads may still read shadow bytes
+// they do not own, such as neighbouring tags during tag generation, so single
+// shadow bytes are read & written with relaxed atomics (plain byte loads &
+// stores in practice) to keep such races well defined.
+
 // Static pointer to the nxsan shadow memory.
 extern uint8_t *__nxsan_shadow;
 
@@ -78,8 +73,47 @@ extern size_t __nxsan_shadow_size;
 // Base of the heap.
 extern uint8_t *__nxsan_heap_base;
 
-// Random generator for tags.
-extern std::uniform_int_distribution<short> __nxsan_tag_gen;
+/******************
+ * Runtime flags. *
+ ******************/
+
+// Runtime options, parsed from the NXSAN_OPTIONS environment variable by
+// __nxsan_init. Only written during initialisation, so hot paths may read them
+// without locks.
+struct alignas(64) __nxsan_flags_t {
+  // Byte budget of the quarantine. Zero disables it.
+  uint64_t quarantineSize;
+  // Number of frames captured for allocation & free stacks. Zero disables
+  // capturing them.
+  uint64_t allocBtDepth;
+  // Maximum number of frames shown for the stack of an error.
+  uint64_t btDepth;
+  // Only 1 in this many fixed size accesses is verified on each thread.
+  // Always at least 1.
+  uint64_t sampleRate;
+  // Path of an llvm-symbolizer compatible binary, or nullptr.
+  const char *symbolizerPath;
+  // Path to write runtime statistics to on termination ("-" for stderr), or
+  // nullptr.
+  const char *statsPath;
+  // Whether errors from bad pointer accesses are logged & execution continued,
+  // rather than aborting. Each distinct (error kind, PC) is only reported once.
+  bool recover;
+};
+static_assert(sizeof(__nxsan_flags_t) == 64,
+              "Runtime flags should fit within a single cache line.");
+
+extern __nxsan_flags_t __nxsan_flags;
+
+// Number of fixed size accesses the current thread skips before the next one
+// is verified. Sampled instrumentation decrements this inline, only calling
+// into the runtime once it reaches zero. Uses the initial-exec TLS model, as
+// the runtime is linked statically into the application.
+extern "C" __attribute__((tls_model("initial-exec"))) thread_local uint64_t
+    __nxsan_sample_countdown;
+
+// Resets the runtime flags to their defaults, then applies NXSAN_OPTIONS.
+void __nxsan_init_flags();
 
 /***************************
  * Internal use utilities. *
@@ -125,11 +159,37 @@ __nxsan_get_shadow_address(void *ptr) {
   return __nxsan_shadow + shadowDist;
 }
 
+// Reads a single shadow byte.
+inline __attribute__((always_inline)) uint8_t
+__nxsan_load_shadow(uint8_t *shadowAddr) {
+  return __atomic_load_n(shadowAddr, __ATOMIC_RELAXED);
+}
+
+// Writes a single shadow byte.
+inline __attribute__((always_inline)) void
+__nxsan_store_shadow(uint8_t *shadowAddr, uint8_t value) {
+  __atomic_store_n(shadowAddr, value, __ATOMIC_RELAXED);
+}
+
+// Fills n shadow bytes starting at dst with the given value, using the widest
+// vector kernel the CPU supports. The vector kernels use plain loads & stores,
+// relying on these being single-copy atomic per byte (as on x86-64) to remain
+// well defined alongside the relaxed accesses above.
+void __nxsan_shadow_fill(uint8_t *dst, uint8_t value, size_t n);
+
+// Returns the index of the first of n shadow bytes starting at src which does
+// not equal the given value, or n if all of them do.
+size_t __nxsan_shadow_find_mismatch(const uint8_t *src, uint8_t value,
+                                    size_t n);
+
+// Selects the bulk shadow kernels for the running CPU.
+void __nxsan_init_shadow_kernels();
+
 // Fetches the tag value for the given pointer.
 inline __attribute__((always_inline)) uint8_t
 __nxsan_get_shadow_tag(void *ptr) {
   uint8_t *shadowAddr = __nxsan_get_shadow_address(ptr);
-  return *shadowAddr;
+  return __nxsan_load_shadow(shadowAddr);
 }
 
 // Verifies that the given pointer:
@@ -141,21 +201,156 @@ __nxsan_get_shadow_tag(void *ptr) {
 // pointers causing an nxsan abort.
 uint8_t __nxsan_verify_ptr(void *ptr);
 
-// Initialises the tag generator for use.
+// Initialises the tag generator for use. Each thread lazily seeds its own
+// generator from the seed chosen here.
 void __nxsan_init_tag_gen();
 
+/***************************
+ * Tracked heap allocator. *
+ ***************************/
+
+// Memory handed out by nxsan is carved directly out of the tracked heap region
+// in granule-aligned size classes, so allocations never fall outside of the
+// tracked bounds. All pointers passed to & returned from these are untagged.
+
+// States of a chunk handed out by the allocator.
+// clang-format off
+#define __NXSAN_CHUNK_FREE        0
+#define __NXSAN_CHUNK_LIVE        1
+#define __NXSAN_CHUNK_QUARANTINED 2
+// clang-format on
+
+// Metadata for a single chunk, kept in a side table owned by its span. Like
+// shadow bytes, each entry is only written by the thread allocating or freeing
+// its chunk.
+struct __nxsan_chunk_meta {
+  // Size requested by the application, in bytes.
+  uint64_t size : 48;
+  // Tag given to the allocation.
+  uint64_t tag : 8;
+  // One of __NXSAN_CHUNK_*.
+  uint64_t state : 8;
+  // Stack depot ids of the allocating & freeing call stacks, or 0 if unknown.
+  uint32_t allocStack;
+  uint32_t freeStack;
+};
+static_assert(sizeof(__nxsan_chunk_meta) == 16,
+              "Chunk metadata should stay two words.");
+
+// Fetches the granule-aligned size of a chunk's allocation in bytes.
+inline __attribute__((always_inline)) size_t
+__nxsan_meta_aligned_size(const __nxsan_chunk_meta *meta) {
+  return (meta->size + __NXSAN_TAG_GRANULARITY_BYTES - 1) /
+         __NXSAN_TAG_GRANULARITY_BYTES * __NXSAN_TAG_GRANULARITY_BYTES;
+}
+
+// Initialises the allocator for the configured heap region. Returns false if
+// the allocator's metadata could not be reserved.
+bool __nxsan_region_init();
+
+// Releases all memory held by the allocator, including live allocations.
+void __nxsan_region_terminate();
+
+// Allocates a granule-aligned chunk of at least the given size from the tracked
+// heap, also returning its metadata entry. Returns nullptr if the region is
+// exhausted.
+void *__nxsan_region_alloc(size_t size, __nxsan_chunk_meta **meta);
+
+// Fetches the metadata for the chunk starting at the given pointer, or nullptr
+// if it is not the start of a chunk handed out by the allocator.
+__nxsan_chunk_meta *__nxsan_region_get_meta(void *ptr);
+
+// Fetches the metadata for the chunk containing the given (untagged) pointer,
+// setting chunk to its start. Returns nullptr if no chunk contains it.
+__nxsan_chunk_meta *__nxsan_region_find_chunk(void *ptr, void **chunk);
+
+// Returns a chunk to the allocator. The pointer must be the start of a chunk.
+void __nxsan_region_free(void *ptr);
+
+// Returns the number of bytes of tracked heap reserved by the allocator.
+size_t __nxsan_region_get_reserved_bytes();
+
+// Calls the given function for every live chunk, with its (untagged) address
+// and metadata. Must not run concurrently with allocation or free.
+void __nxsan_region_for_each_live(void (*fn)(void *ptr,
+                                             const __nxsan_chunk_meta *meta,
+                                             void *ctx),
+                                  void *ctx);
+
+/***************
+ * Quarantine. *
+ ***************/
+
+// Freed chunks are held in a bounded FIFO quarantine with their shadow
+// poisoned, delaying reuse so that use-after-free is caught for longer.
+
+// Returns the number of bytes currently held in the global quarantine.
+size_t __nxsan_quarantine_get_bytes();
+
+// Places a freed (untagged) chunk with the given aligned size in quarantine,
+// recycling the oldest chunks once over budget. Shadow for the chunk must
+// already be cleared.
+void __nxsan_quarantine_put(void *ptr, size_t size);
+
+// Drops everything in quarantine without recycling it. Called by
+// __nxsan_terminate before the tracked heap is released.
+void __nxsan_quarantine_terminate();
+
 /********************
  * Error utilities. *
  ********************/
 
-// Aborts the running application with an error stemming from a bad pointer
-// access.
-void __nxsan_abort_with_access_err(void *ptr, const char *fmt, ...);
+// Returns the number of access errors reported so far.
+uint64_t __nxsan_get_num_reports();
+
+// Reports an error stemming from a bad pointer access made from the given PC,
+// then aborts the running application unless in recover mode. The format
+// string identifies the kind of error for deduplication.
+void __nxsan_report_access_err(void *pc, void *ptr, const char *fmt, ...);
+
+// Reports an error stemming from a bad pointer access, attributing it to the
+// caller of the enclosing runtime entry point. Must only be used within
+// extern "C" entry points, or helpers always inlined into them.
+#define __NXSAN_REPORT_ACCESS_ERR(ptr, ...)                                    \
+  __nxsan_report_access_err(__builtin_return_address(0), ptr, __VA_ARGS__)
 
 // Aborts the running application with a generic error.
 void __nxsan_abort_with_err(const char *fmt, ...);
 
+// Reports a generic error, then aborts the running application unless in
+// recover mode.
+void __nxsan_report_err(const char *fmt, ...);
+
 // Creates a backtrace of the current call stack.
 std::string __nxsan_bt();
 
+// Resolves a PC to its function, source location and module, caching the
+// result. File & line information is only available when an external
+// symbolizer is configured through the symbolizer_path flag.
+std::string __nxsan_symbolize_pc(void *pc);
+
+/****************
+ * Stack depot. *
+ ****************/
+
+// Stores the given stack of PCs in the stack depot, returning a 32-bit id
+// which is identical for identical stacks. Lock-free, and never frees. Returns
+// 0 if the depot is full.
+uint32_t __nxsan_depot_put(void *const *pcs, size_t size);
+
+// Returns the number of bytes used by the stack depot.
+size_t __nxsan_depot_get_used_bytes();
+
+// Fetches the stack with the given id, returning the number of PCs and setting
+// pcs to point at them. Returns 0 for unknown ids.
+size_t __nxsan_depot_get(uint32_t id, void *const **pcs);
+
+// Captures the calling stack (without symbolizing it) into the stack depot,
+// returning its id. Walks frame pointers rather than unwinding, so the stack
+// ends at the first caller built without them.
+uint32_t __nxsan_capture_stack();
+
+// Creates a symbolized backtrace for the stack with the given id.
+std::string __nxsan_format_stack(uint32_t id);
+
 #endif
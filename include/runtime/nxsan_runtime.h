@@ -20,6 +20,18 @@ extern "C" bool __nxsan_init(void* hBase, size_t hSize);
 // Returns whether nxsan was terminated successfully from the method call.
 extern "C" bool __nxsan_terminate();
 
+// Sets whether bad accesses are logged & execution continued (recover mode),
+// rather than aborting. Each kind of error is only reported once per PC.
+// Recover mode can also be enabled with NXSAN_OPTIONS=recover=1 before init,
+// which this overrides.
+extern "C" void __nxsan_set_recover(bool recover);
+
+// Sets the sampling rate of access checks, so that only 1 in every rate
+// fixed size accesses is verified on each thread. A rate of 1 (the default)
+// verifies every access. Other threads pick up the new rate after their next
+// sampled access. Can also be set with NXSAN_OPTIONS=sample_rate=N before init.
+extern "C" void __nxsan_set_sample_rate(size_t rate);
+
 // Allocates size bytes of uninitialized shadow-memory tracked storage.
 // If allocation succeeds, returns a pointer to the lowest (first) byte in the allocated
 // memory block that is suitably aligned for any scalar type (at least as strictly as std::max_align_t)
@@ -35,9 +47,9 @@ extern "C" void* __nxsan_malloc(size_t size);
 //     earlier by __nxsan_malloc(size_t).
 extern "C" void __nxsan_free(void* ptr);
 
-/***************************************
- * Reporting functions for sizes 8-64. *
- ***************************************/
+/****************************************
+ * Reporting functions for sizes 8-512. *
+ ****************************************/
 
 // Don't mark reporting calls as inline if requested by including source.
 #ifdef __NXSAN_OUTLINE_REPORTING
@@ -54,5 +66,52 @@ __NXSAN_LD_STR_REPORT_FOR_SIZE(8)
 __NXSAN_LD_STR_REPORT_FOR_SIZE(16)
 __NXSAN_LD_STR_REPORT_FOR_SIZE(32)
 __NXSAN_LD_STR_REPORT_FOR_SIZE(64)
+__NXSAN_LD_STR_REPORT_FOR_SIZE(128)
+__NXSAN_LD_STR_REPORT_FOR_SIZE(256)
+__NXSAN_LD_STR_REPORT_FOR_SIZE(512)
+
+// Verifies an atomic read-modify-write (or compare-exchange) at p, which both
+// loads & stores the same bytes, with a single check.
+#ifdef __NXSAN_OUTLINE_REPORTING
+#define __NXSAN_RMW_REPORT_FOR_SIZE(x) \
+  extern "C" void __nxsan_report_rmw##x(void* p);
+#else
+#define __NXSAN_RMW_REPORT_FOR_SIZE(x) \
+  extern "C" __attribute__((always_inline)) void __nxsan_report_rmw##x(void* p);
+#endif
+
+__NXSAN_RMW_REPORT_FOR_SIZE(8)
+__NXSAN_RMW_REPORT_FOR_SIZE(16)
+__NXSAN_RMW_REPORT_FOR_SIZE(32)
+__NXSAN_RMW_REPORT_FOR_SIZE(64)
+__NXSAN_RMW_REPORT_FOR_SIZE(128)
+
+// Verifies a single load/store/read-modify-write of any other size (such as
+// aggregates or odd-sized vectors) starting at p. Sampled like the fixed size
+// functions.
+extern "C" void __nxsan_report_load_n(void* p, size_t size);
+extern "C" void __nxsan_report_store_n(void* p, size_t size);
+extern "C" void __nxsan_report_rmw_n(void* p, size_t size);
+
+/**********************************************
+ * Reporting functions for contiguous ranges. *
+ **********************************************/
+
+// Verifies a load/store of size bytes starting at p, checking every granule
+// the range covers in a single pass over shadow memory.
+extern "C" void __nxsan_report_load_range(void* p, size_t size);
+extern "C" void __nxsan_report_store_range(void* p, size_t size);
+
+/*****************************
+ * Bulk memory operations.   *
+ *****************************/
+
+// Equivalents of memcpy, memmove & memset which first verify that the source
+// & destination ranges are valid, reporting any errors. Instrumented code
+// calls these in place of the corresponding LLVM intrinsics & libc calls.
+// Returns dst.
+extern "C" void* __nxsan_memcpy(void* dst, const void* src, size_t size);
+extern "C" void* __nxsan_memmove(void* dst, const void* src, size_t size);
+extern "C" void* __nxsan_memset(void* dst, int value, size_t size);
 
 #endif
@@ -0,0 +1,106 @@
+#include "instrumentation/AccessCoalescer.hpp"
+#include "instrumentation/RedundantCheckEliminator.hpp"
+
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/Support/Casting.h>
+#include <algorithm>
+
+#include "runtime/nxsan_internal.h"
+
+// Largest gap (in bytes) allowed between the spans of two accesses in the same
+// group, such as struct padding. Bytes within the gap are checked too, so this
+// is kept small enough that the gap lies within the same object.
+#define NXSAN_COALESCE_MAX_GAP __NXSAN_TAG_GRANULARITY_BYTES
+
+namespace nxsan {
+
+AccessCoalescer::AccessCoalescer(llvm::Function &func,
+                                 const llvm::DataLayout &layout)
+    : m_func(func), m_layout(layout) {}
+
+void AccessCoalescer::Run(const std::vector<llvm::Instruction *> &accesses,
+                          llvm::FunctionCallee loadRange,
+                          llvm::FunctionCallee storeRange) {
+  m_accesses = std::unordered_set<llvm::Instruction *>(accesses.begin(),
+                                                       accesses.end());
+  m_coalesced.clear();
+  for (llvm::BasicBlock &bb : m_func) {
+    ProcessBlock(bb, loadRange, storeRange);
+  }
+}
+
+void AccessCoalescer::ProcessBlock(llvm::BasicBlock &bb,
+                                   llvm::FunctionCallee loadRange,
+                                   llvm::FunctionCallee storeRange) {
+  std::vector<Group> groups;
+  auto flushAll = [&]() {
+    for (const Group &group : groups) {
+      FlushGroup(group, loadRange, storeRange);
+    }
+    groups.clear();
+  };
+
+  for (llvm::Instruction &inst : bb) {
+    // Decompose the accessed pointer into a base & constant offset. Atomic
+    // read-modify-writes & accesses of scalable vectors are left as they are.
+    llvm::Value *ptr = m_accesses.count(&inst)
+                           ? llvm::getLoadStorePointerOperand(&inst)
+                           : nullptr;
+    llvm::TypeSize size =
+        ptr ? m_layout.getTypeStoreSize(llvm::getLoadStoreType(&inst))
+            : llvm::TypeSize::getFixed(0);
+    if (ptr && !size.isScalable()) {
+      int64_t offset = 0;
+      llvm::Value *base =
+          llvm::GetPointerBaseWithConstantOffset(ptr, offset, m_layout);
+      bool isStore = llvm::isa<llvm::StoreInst>(inst);
+      int64_t end = offset + (int64_t)size.getFixedSize();
+
+      // Extend an open group if this access is close enough to its span,
+      // otherwise it starts a new group.
+      auto it = std::find_if(groups.begin(), groups.end(), [&](const Group &g) {
+        return g.base == base && g.isStore == isStore &&
+               offset <= g.high + NXSAN_COALESCE_MAX_GAP &&
+               end + NXSAN_COALESCE_MAX_GAP >= g.low;
+      });
+      if (it != groups.end()) {
+        it->low = std::min(it->low, offset);
+        it->high = std::max(it->high, end);
+        it->members.push_back(&inst);
+      } else {
+        groups.push_back({base, isStore, offset, end, {&inst}});
+      }
+    }
+
+    // Later accesses must be certain to execute, with their memory still
+    // allocated, when the group is checked.
+    if (RedundantCheckEliminator::MayFree(inst) ||
+        !llvm::isGuaranteedToTransferExecutionToSuccessor(&inst)) {
+      flushAll();
+    }
+  }
+  flushAll();
+}
+
+void AccessCoalescer::FlushGroup(const Group &group,
+                                 llvm::FunctionCallee loadRange,
+                                 llvm::FunctionCallee storeRange) {
+  // Single accesses keep their own (possibly inline) check.
+  if (group.members.size() < 2) {
+    return;
+  }
+
+  // The base dominates every member, as each member's address is computed
+  // from it.
+  llvm::IRBuilder<> builder(group.members.front());
+  llvm::Value *low = builder.CreatePtrToInt(group.base, builder.getInt64Ty());
+  if (group.low != 0) {
+    low = builder.CreateAdd(low, builder.getInt64(group.low));
+  }
+  llvm::Value *args[] = {low, builder.getInt64(group.high - group.low)};
+  builder.CreateCall(group.isStore ? storeRange : loadRange, args);
+  m_coalesced.insert(group.members.begin(), group.members.end());
+}
+
+} // namespace nxsan
@@ -1,31 +1,49 @@
 #include "instrumentation/AccessInstrumenter.hpp"
+#include "instrumentation/AccessCoalescer.hpp"
+#include "instrumentation/LoopCheckHoister.hpp"
+#include "instrumentation/RedundantCheckEliminator.hpp"
 
+#include <llvm/Analysis/ValueTracking.h>
 #include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
 #include <llvm/IR/IRBuilder.h>
 #include <llvm/IR/Instructions.h>
+#include <llvm/IR/IntrinsicInst.h>
 #include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/MDBuilder.h>
 #include <llvm/IRReader/IRReader.h>
 #include <llvm/Support/Casting.h>
+#include <llvm/Support/FileSystem.h>
 #include <llvm/Support/SourceMgr.h>
 #include <llvm/Support/raw_ostream.h>
+#include <algorithm>
+#include <vector>
 
-namespace nxsan {
+#include "runtime/nxsan_internal.h"
 
-AccessInstrumenter::AccessInstrumenter(const std::string &llvmIrPath)
-    : m_filePath(llvmIrPath), m_numLoads{0}, m_numStores{0} {}
+// Branch weight given to the likely (no report) edge of an inline check.
+#define NXSAN_INLINE_LIKELY_WEIGHT 100000
 
-NxsResult<InstrumentedIr, std::string> AccessInstrumenter::GenerateIR() {
-  // Reset loads, stores.
-  m_numLoads = 0;
-  m_numStores = 0;
+namespace nxsan {
+
+AccessInstrumenter::AccessInstrumenter(const InstrumenterOptions &options)
+    : m_mod(nullptr), m_shadowGlobal(nullptr), m_heapBaseGlobal(nullptr),
+      m_shadowSizeGlobal(nullptr), m_sampleCountdownGlobal(nullptr),
+      m_flagsGlobal(nullptr), m_options(options), m_numLoads{0},
+      m_numStores{0}, m_numRemovedChecks{0}, m_numHoistedChecks{0},
+      m_numBulkOps{0}, m_numElidedChecks{0}, m_numCoalescedChecks{0},
+      m_modified{false} {}
 
+NxsResult<InstrumentedIr, std::string>
+AccessInstrumenter::GenerateIR(const std::string &inPath,
+                               const std::string &outPath, IrFormat format) {
   // Attempt to load LLVM module from file.
   llvm::LLVMContext context;
   llvm::SMDiagnostic err;
-  m_mod = llvm::parseIRFile(m_filePath, err, context);
+  std::unique_ptr<llvm::Module> mod = llvm::parseIRFile(inPath, err, context);
 
   // If we failed to load the LLVM IR, report an error.
-  if (!m_mod) {
+  if (!mod) {
     std::string errMsg;
     {
       llvm::raw_string_ostream outStr(errMsg);
@@ -34,8 +52,56 @@ NxsResult<InstrumentedIr, std::string> AccessInstrumenter::GenerateIR() {
     return errMsg;
   }
 
+  InstrumentedIr stats = InstrumentModule(*mod);
+
+  // Stream the module out to file.
+  std::error_code ec;
+  llvm::raw_fd_ostream outStream(outPath, ec,
+                                 format == IrFormat::Bitcode
+                                     ? llvm::sys::fs::OF_None
+                                     : llvm::sys::fs::OF_Text);
+  if (ec) {
+    return "Failed to open output file '" + outPath + "': " + ec.message();
+  }
+  if (format == IrFormat::Bitcode) {
+    llvm::WriteBitcodeToFile(*mod, outStream);
+  } else {
+    mod->print(outStream, nullptr);
+  }
+  outStream.close();
+
+  if (outStream.has_error()) {
+    std::string errMsg = "Failed to write output file '" + outPath +
+                         "': " + outStream.error().message();
+    outStream.clear_error();
+    return errMsg;
+  }
+
+  return stats;
+}
+
+InstrumentedIr AccessInstrumenter::InstrumentModule(llvm::Module &mod) {
+  // Reset loads, stores.
+  m_numLoads = 0;
+  m_numStores = 0;
+  m_numRemovedChecks = 0;
+  m_numHoistedChecks = 0;
+  m_numBulkOps = 0;
+  m_numElidedChecks = 0;
+  m_numCoalescedChecks = 0;
+  m_modified = false;
+  m_mod = &mod;
+  m_libInfo = std::make_unique<llvm::TargetLibraryInfoImpl>(
+      llvm::Triple(mod.getTargetTriple()));
+
   // Insert function declarations for the external instrumentation functions.
-  DeclareInstruments(context);
+  DeclareInstruments(mod.getContext());
+  if (m_options.inlineChecks) {
+    DeclareShadowGlobals(mod.getContext());
+  }
+  if (m_options.sampleChecks) {
+    DeclareSampleGlobals(mod.getContext());
+  }
 
   // Iterate over all BB instructions, instrument them.
   for (auto mit = m_mod->begin(); mit != m_mod->end(); ++mit) {
@@ -46,35 +112,100 @@ NxsResult<InstrumentedIr, std::string> AccessInstrumenter::GenerateIR() {
       continue;
     }
 
-    for (auto fit = func.begin(); fit != func.end(); ++fit) {
-      llvm::BasicBlock &bb = *fit;
-      for (auto bbit = bb.begin(); bbit != bb.end(); ++bbit) {
-        InstrumentInstr(*bbit);
+    InstrumentFunction(func);
+  }
+
+  // Unload module.
+  m_mod = nullptr;
+
+  return InstrumentedIr{m_numLoads, m_numStores, m_numRemovedChecks,
+                        m_numHoistedChecks, m_numBulkOps, m_numElidedChecks,
+                        m_numCoalescedChecks, m_modified};
+}
+
+void AccessInstrumenter::InstrumentFunction(llvm::Function &func) {
+  // Collect accesses up front, as inline checks split basic blocks. Accesses
+  // which can never touch the tracked heap are skipped entirely.
+  std::vector<llvm::Instruction *> accesses;
+  std::vector<llvm::CallBase *> bulkOps;
+  for (auto fit = func.begin(); fit != func.end(); ++fit) {
+    llvm::BasicBlock &bb = *fit;
+    for (auto bbit = bb.begin(); bbit != bb.end(); ++bbit) {
+      bool isAccess = GetInstrumentMode(*bbit).has_value();
+      bool isBulkOp =
+          !isAccess && m_options.instrumentBulkOps && IsBulkOp(*bbit);
+      if (!isAccess && !isBulkOp) {
+        continue;
+      }
+      if (m_options.elideNonHeapChecks && IsNonHeapAccess(*bbit)) {
+        m_numElidedChecks++;
+      } else if (isAccess) {
+        accesses.push_back(&*bbit);
+      } else {
+        bulkOps.push_back(llvm::cast<llvm::CallBase>(&*bbit));
       }
     }
   }
 
-  // Output module.
-  std::string moduleLlvm;
-  {
-    llvm::raw_string_ostream modStream(moduleLlvm);
-    modStream << *m_mod;
+  // Drop accesses which are already covered by a dominating check.
+  if (m_options.eliminateRedundantChecks && !accesses.empty()) {
+    RedundantCheckEliminator elim(func, m_mod->getDataLayout());
+    elim.Run(accesses);
+    m_numRemovedChecks += elim.GetNumRedundant();
+    accesses.erase(std::remove_if(accesses.begin(), accesses.end(),
+                                  [&](llvm::Instruction *inst) {
+                                    return elim.IsRedundant(inst);
+                                  }),
+                   accesses.end());
   }
 
-  // Unload module.
-  m_mod = nullptr;
+  // Replace checks of affine accesses in loops with preheader range checks.
+  if (m_options.hoistLoopChecks && !accesses.empty()) {
+    LoopCheckHoister hoister(func, m_mod->getDataLayout());
+    hoister.Run(accesses, m_loadRangeCallee, m_storeRangeCallee);
+    m_numHoistedChecks += hoister.GetNumHoisted();
+    m_modified |= hoister.GetNumHoisted() > 0;
+    accesses.erase(std::remove_if(accesses.begin(), accesses.end(),
+                                  [&](llvm::Instruction *inst) {
+                                    return hoister.IsHoisted(inst);
+                                  }),
+                   accesses.end());
+  }
+
+  // Merge checks of nearby accesses from the same pointer within a block. Range
+  // checks are neither sampled nor inlined, so this is skipped when either is
+  // requested to keep those accesses on their cheaper per-access paths.
+  if (m_options.coalesceChecks && !m_options.sampleChecks &&
+      !m_options.inlineChecks && !accesses.empty()) {
+    AccessCoalescer coalescer(func, m_mod->getDataLayout());
+    coalescer.Run(accesses, m_loadRangeCallee, m_storeRangeCallee);
+    m_numCoalescedChecks += coalescer.GetNumCoalesced();
+    m_modified |= coalescer.GetNumCoalesced() > 0;
+    accesses.erase(std::remove_if(accesses.begin(), accesses.end(),
+                                  [&](llvm::Instruction *inst) {
+                                    return coalescer.IsCoalesced(inst);
+                                  }),
+                   accesses.end());
+  }
 
-  return InstrumentedIr{moduleLlvm, m_numLoads, m_numStores};
+  for (llvm::Instruction *inst : accesses) {
+    InstrumentInstr(*inst);
+  }
+  for (llvm::CallBase *call : bulkOps) {
+    InstrumentBulkOp(*call);
+  }
 }
 
 void AccessInstrumenter::InstrumentInstr(llvm::Instruction &inst) {
-  // Attempt to get the instrument mode.
+  // Attempt to get the instrument mode. Zero sized accesses touch no memory.
   auto modeOpt = GetInstrumentMode(inst);
-  if (!modeOpt.has_value()) {
+  if (!modeOpt.has_value() ||
+      m_mod->getDataLayout().getTypeStoreSize(GetLoadStoreType(&inst)).isZero()) {
     return;
   }
 
   // Increment count appropriately.
+  m_modified = true;
   InstrumentMode mode = modeOpt.value();
   switch (mode) {
   case InstrumentMode::Load:
@@ -83,24 +214,242 @@ void AccessInstrumenter::InstrumentInstr(llvm::Instruction &inst) {
   case InstrumentMode::Store:
     m_numStores++;
     break;
+  case InstrumentMode::ReadModifyWrite:
+    m_numLoads++;
+    m_numStores++;
+    break;
   }
 
-  // Fetch instrument size.
+  // Fetch instrument size. Atomics are at most 128 bits wide, anything wider
+  // uses the sized instrument.
   InstrumentSize size = GetInstrumentSize(inst);
+  if (mode == InstrumentMode::ReadModifyWrite && size > InstrumentSize::A128) {
+    size = InstrumentSize::Sized;
+  }
 
-  // Insert the instrumenting call.
+  // When sampling, only emit the check on the sampled path.
+  llvm::Instruction *insertPt = &inst;
+  if (m_options.sampleChecks) {
+    insertPt = InsertSampleGate(inst);
+  }
+
+  // Instruments take the address as an integer.
+  llvm::IRBuilder<> builder(insertPt);
+  llvm::Value *addr =
+      builder.CreatePtrToInt(GetPointerOperand(inst), builder.getInt64Ty());
+
+  // Other sizes pass the size through to the runtime.
+  if (size == InstrumentSize::Sized) {
+    llvm::Value *args[] = {addr, CreateAccessSize(builder, inst)};
+    builder.CreateCall(GetInstrument(mode, size), args);
+    return;
+  }
+
+  // Either emit the fast path inline, or insert the instrumenting call. The
+  // inline check only compares a single granule's tag, so is limited to
+  // accesses of up to 64 bits.
   auto callee = GetInstrument(mode, size);
-  llvm::IRBuilder<> builder(&inst);
-  llvm::Value *args[] = {GetPointerOperand(inst)};
+  if (m_options.inlineChecks && size <= InstrumentSize::A64) {
+    InstrumentInline(*insertPt, addr, callee);
+    return;
+  }
+  llvm::Value *args[] = {addr};
   builder.CreateCall(callee, args);
 }
 
+void AccessInstrumenter::InstrumentBulkOp(llvm::CallBase &call) {
+  m_numBulkOps++;
+  m_modified = true;
+
+  // Direct libc calls share the signature of the runtime wrappers, so only
+  // need redirecting.
+  auto *intrinsic = llvm::dyn_cast<llvm::MemIntrinsic>(&call);
+  if (!intrinsic) {
+    llvm::LibFunc func;
+    m_libInfo->getLibFunc(*call.getCalledFunction(), func);
+    call.setCalledFunction(func == llvm::LibFunc_memcpy    ? m_memcpyCallee
+                           : func == llvm::LibFunc_memmove ? m_memmoveCallee
+                                                           : m_memsetCallee);
+    return;
+  }
+
+  llvm::IRBuilder<> builder(&call);
+  llvm::Type *ptrTy = builder.getInt8PtrTy();
+  llvm::Value *dst = builder.CreatePointerCast(intrinsic->getRawDest(), ptrTy);
+  llvm::Value *size =
+      builder.CreateZExtOrTrunc(intrinsic->getLength(), builder.getInt64Ty());
+  auto *transfer = llvm::dyn_cast<llvm::MemTransferInst>(intrinsic);
+  llvm::Value *src =
+      transfer ? builder.CreatePointerCast(transfer->getRawSource(), ptrTy)
+               : nullptr;
+
+  // Volatile & inline operations must be kept as they are, so only verify
+  // their ranges beforehand.
+  if (intrinsic->isVolatile() || llvm::isa<llvm::MemCpyInlineInst>(intrinsic)) {
+    if (src) {
+      llvm::Value *args[] = {
+          builder.CreatePtrToInt(src, builder.getInt64Ty()), size};
+      builder.CreateCall(m_loadRangeCallee, args);
+    }
+    llvm::Value *args[] = {builder.CreatePtrToInt(dst, builder.getInt64Ty()),
+                           size};
+    builder.CreateCall(m_storeRangeCallee, args);
+    return;
+  }
+
+  // Otherwise, the wrapper verifies the ranges & performs the operation.
+  if (auto *memset = llvm::dyn_cast<llvm::MemSetInst>(intrinsic)) {
+    llvm::Value *args[] = {
+        dst, builder.CreateZExt(memset->getValue(), builder.getInt32Ty()),
+        size};
+    builder.CreateCall(m_memsetCallee, args);
+  } else {
+    llvm::Value *args[] = {dst, src, size};
+    builder.CreateCall(llvm::isa<llvm::MemMoveInst>(intrinsic)
+                           ? m_memmoveCallee
+                           : m_memcpyCallee,
+                       args);
+  }
+  call.eraseFromParent();
+}
+
+llvm::Instruction *
+AccessInstrumenter::InsertSampleGate(llvm::Instruction &inst) {
+  // The emitted control flow is as follows:
+  //   head:   thread's countdown non-zero?     -> skip, else sample
+  //   skip:   decrement the countdown,         -> cont
+  //   sample: check (inserted by the caller)   -> cont
+  // The runtime rearms the countdown when a sampled access calls into it.
+  // Inline checks may not call into the runtime, so rearm the countdown
+  // directly after them instead.
+  llvm::LLVMContext &ctx = inst.getContext();
+  llvm::BasicBlock *head = inst.getParent();
+  llvm::Function *func = head->getParent();
+  llvm::BasicBlock *cont = head->splitBasicBlock(&inst, "nxsan.sample.cont");
+  llvm::BasicBlock *skip =
+      llvm::BasicBlock::Create(ctx, "nxsan.sample.skip", func, cont);
+  llvm::BasicBlock *sample =
+      llvm::BasicBlock::Create(ctx, "nxsan.sample", func, cont);
+  llvm::MDNode *likely = llvm::MDBuilder(ctx).createBranchWeights(
+      NXSAN_INLINE_LIKELY_WEIGHT, 1);
+  llvm::Type *i64Ty = llvm::Type::getInt64Ty(ctx);
+
+  // Skip the access while the countdown is non-zero.
+  head->getTerminator()->eraseFromParent();
+  llvm::IRBuilder<> builder(head);
+  llvm::Value *countdown = builder.CreateLoad(i64Ty, m_sampleCountdownGlobal,
+                                              "nxsan.sample.countdown");
+  builder.CreateCondBr(builder.CreateICmpNE(countdown, builder.getInt64(0)),
+                       skip, sample, likely);
+
+  builder.SetInsertPoint(skip);
+  builder.CreateStore(builder.CreateSub(countdown, builder.getInt64(1)),
+                      m_sampleCountdownGlobal);
+  builder.CreateBr(cont);
+
+  // The check is inserted before the end of the sampled block, or before the
+  // rearm for inline checks.
+  builder.SetInsertPoint(sample);
+  llvm::Instruction *end = builder.CreateBr(cont);
+  if (m_options.inlineChecks) {
+    return InsertSampleRearm(*end);
+  }
+  return end;
+}
+
+llvm::Instruction *
+AccessInstrumenter::InsertSampleRearm(llvm::Instruction &inst) {
+  // Reset the countdown to the runtime's sample rate, less this access.
+  llvm::IRBuilder<> builder(&inst);
+  llvm::Type *i64Ty = builder.getInt64Ty();
+  llvm::Value *ratePtr = builder.CreateConstInBoundsGEP1_64(
+      builder.getInt8Ty(),
+      builder.CreateBitCast(m_flagsGlobal, builder.getInt8PtrTy()),
+      offsetof(__nxsan_flags_t, sampleRate));
+  llvm::LoadInst *rate = builder.CreateLoad(
+      i64Ty, builder.CreateBitCast(ratePtr, i64Ty->getPointerTo()),
+      "nxsan.sample.rate");
+  builder.CreateStore(builder.CreateSub(rate, builder.getInt64(1)),
+                      m_sampleCountdownGlobal);
+  return rate;
+}
+
+void AccessInstrumenter::InstrumentInline(llvm::Instruction &inst,
+                                          llvm::Value *addr,
+                                          llvm::FunctionCallee slowPath) {
+  // The emitted control flow is as follows:
+  //   head:   untagged pointer outside the null page? -> cont, else check
+  //   check:  tagged & within tracked heap?           -> shadow, else slow
+  //   shadow: shadow tag equals pointer tag?          -> cont, else slow
+  //   slow:   full runtime verification, then        -> cont
+  // Short granules, errors and an uninitialised runtime (shadow size of zero)
+  // all fall through to the slow path, which performs the full check.
+  llvm::LLVMContext &ctx = inst.getContext();
+  llvm::BasicBlock *head = inst.getParent();
+  llvm::Function *func = head->getParent();
+  llvm::BasicBlock *cont = head->splitBasicBlock(&inst, "nxsan.cont");
+  llvm::BasicBlock *check =
+      llvm::BasicBlock::Create(ctx, "nxsan.check", func, cont);
+  llvm::BasicBlock *shadow =
+      llvm::BasicBlock::Create(ctx, "nxsan.shadow", func, cont);
+  llvm::BasicBlock *slow =
+      llvm::BasicBlock::Create(ctx, "nxsan.slow", func, cont);
+  llvm::MDNode *unlikely = llvm::MDBuilder(ctx).createBranchWeights(
+      1, NXSAN_INLINE_LIKELY_WEIGHT);
+  llvm::Type *i8Ty = llvm::Type::getInt8Ty(ctx);
+  llvm::Type *i64Ty = llvm::Type::getInt64Ty(ctx);
+
+  // Extract the tag, skip untagged pointers outside of the null page.
+  head->getTerminator()->eraseFromParent();
+  llvm::IRBuilder<> builder(head);
+  llvm::Value *tag = builder.CreateTrunc(
+      builder.CreateLShr(addr, 64 - __NXSAN_TAG_SIZE_BITS), i8Ty, "nxsan.tag");
+  llvm::Value *untagged = builder.CreateAnd(addr, __NXSAN_INVERSE_TAG_MASK);
+  llvm::Value *isTagged = builder.CreateICmpNE(tag, builder.getInt8(0));
+  llvm::Value *inNullPage =
+      builder.CreateICmpULT(untagged, builder.getInt64(__NXSAN_PAGE_SIZE_BYTES));
+  builder.CreateCondBr(builder.CreateOr(isTagged, inNullPage), check, cont);
+
+  // Verify the pointer is tagged and within the tracked heap.
+  builder.SetInsertPoint(check);
+  llvm::Value *heapBase = builder.CreatePtrToInt(
+      builder.CreateLoad(builder.getInt8PtrTy(), m_heapBaseGlobal), i64Ty);
+  llvm::Value *shadowSize = builder.CreateLoad(i64Ty, m_shadowSizeGlobal);
+  llvm::Value *offset = builder.CreateSub(untagged, heapBase);
+  llvm::Value *inHeap = builder.CreateICmpULT(
+      offset, builder.CreateMul(shadowSize, builder.getInt64(
+                                                __NXSAN_TAG_GRANULARITY_BYTES)));
+  builder.CreateCondBr(builder.CreateAnd(isTagged, inHeap), shadow, slow);
+
+  // Compare the pointer tag against the shadow tag.
+  builder.SetInsertPoint(shadow);
+  llvm::Value *shadowBase =
+      builder.CreateLoad(builder.getInt8PtrTy(), m_shadowGlobal);
+  llvm::Value *shadowAddr = builder.CreateInBoundsGEP(
+      i8Ty, shadowBase,
+      builder.CreateUDiv(offset,
+                         builder.getInt64(__NXSAN_TAG_GRANULARITY_BYTES)));
+  llvm::Value *shadowTag = builder.CreateLoad(i8Ty, shadowAddr);
+  builder.CreateCondBr(builder.CreateICmpNE(shadowTag, tag), slow, cont,
+                       unlikely);
+
+  // Slow path, defer to the runtime.
+  builder.SetInsertPoint(slow);
+  llvm::Value *args[] = {addr};
+  llvm::CallInst *call = builder.CreateCall(slowPath, args);
+  call->addFnAttr(llvm::Attribute::Cold);
+  builder.CreateBr(cont);
+}
+
 llvm::Value *AccessInstrumenter::GetPointerOperand(llvm::Instruction &instr) {
-  assert(
-      (llvm::isa<llvm::LoadInst>(instr) || llvm::isa<llvm::StoreInst>(instr)) &&
-      "Expected Load or Store instruction");
+  assert(GetInstrumentMode(instr).has_value() &&
+         "Expected Load, Store or atomic instruction");
   if (auto *LI = llvm::dyn_cast<llvm::LoadInst>(&instr))
     return LI->getPointerOperand();
+  if (auto *RMW = llvm::dyn_cast<llvm::AtomicRMWInst>(&instr))
+    return RMW->getPointerOperand();
+  if (auto *CX = llvm::dyn_cast<llvm::AtomicCmpXchgInst>(&instr))
+    return CX->getPointerOperand();
   return llvm::cast<llvm::StoreInst>(&instr)->getPointerOperand();
 }
 
@@ -112,13 +461,75 @@ AccessInstrumenter::GetInstrumentMode(llvm::Instruction &instr) {
   if (llvm::isa<llvm::StoreInst>(&instr)) {
     return InstrumentMode::Store;
   }
+  if (llvm::isa<llvm::AtomicRMWInst>(&instr) ||
+      llvm::isa<llvm::AtomicCmpXchgInst>(&instr)) {
+    return InstrumentMode::ReadModifyWrite;
+  }
   return std::nullopt;
 }
 
+bool AccessInstrumenter::IsBulkOp(llvm::Instruction &instr) {
+  // Intrinsics on other address spaces are left alone, as the runtime only
+  // tracks the default address space.
+  if (auto *intrinsic = llvm::dyn_cast<llvm::MemIntrinsic>(&instr)) {
+    auto *transfer = llvm::dyn_cast<llvm::MemTransferInst>(intrinsic);
+    return intrinsic->getDestAddressSpace() == 0 &&
+           (!transfer || transfer->getSourceAddressSpace() == 0);
+  }
+
+  // Calls to the libc functions, as opposed to local definitions of them.
+  auto *call = llvm::dyn_cast<llvm::CallBase>(&instr);
+  llvm::Function *callee = call ? call->getCalledFunction() : nullptr;
+  llvm::LibFunc func;
+  if (!callee || !callee->isDeclaration() ||
+      !m_libInfo->getLibFunc(*callee, func)) {
+    return false;
+  }
+  return func == llvm::LibFunc_memcpy || func == llvm::LibFunc_memmove ||
+         func == llvm::LibFunc_memset;
+}
+
+bool AccessInstrumenter::IsNonHeapAccess(llvm::Instruction &instr) {
+  if (GetInstrumentMode(instr).has_value()) {
+    return IsNonHeapPointer(GetPointerOperand(instr));
+  }
+
+  // Bulk operations are elided, leaving any LLVM intrinsic for the backend to
+  // expand inline, only if both their source & destination are off the heap.
+  // Otherwise they are rewritten to call the runtime's checked wrappers.
+  auto &call = llvm::cast<llvm::CallBase>(instr);
+  if (!IsNonHeapPointer(call.getArgOperand(0))) {
+    return false;
+  }
+  llvm::LibFunc func;
+  bool isMemset =
+      llvm::isa<llvm::MemIntrinsic>(call)
+          ? llvm::isa<llvm::MemSetInst>(call)
+          : m_libInfo->getLibFunc(*call.getCalledFunction(), func) &&
+                func == llvm::LibFunc_memset;
+  return isMemset || IsNonHeapPointer(call.getArgOperand(1));
+}
+
+bool AccessInstrumenter::IsNonHeapPointer(const llvm::Value *ptr) {
+  // Stack objects (including by-value argument copies), globals & functions
+  // are never allocated by the runtime, so pointers into them are untagged.
+  // Null pointers must still be checked, to catch null page accesses.
+  const llvm::Value *obj = llvm::getUnderlyingObject(ptr);
+  if (auto *arg = llvm::dyn_cast<llvm::Argument>(obj)) {
+    return arg->hasPassPointeeByValueCopyAttr();
+  }
+  return llvm::isa<llvm::AllocaInst>(obj) ||
+         llvm::isa<llvm::GlobalVariable>(obj) || llvm::isa<llvm::Function>(obj);
+}
+
 InstrumentSize AccessInstrumenter::GetInstrumentSize(llvm::Instruction &instr) {
   llvm::Type *origType = GetLoadStoreType(&instr);
-  uint64_t storeSize = m_mod->getDataLayout().getTypeStoreSizeInBits(origType);
-  switch (storeSize) {
+  llvm::TypeSize storeSize =
+      m_mod->getDataLayout().getTypeStoreSizeInBits(origType);
+  if (storeSize.isScalable()) {
+    return InstrumentSize::Sized;
+  }
+  switch (storeSize.getFixedSize()) {
   case 8:
     return InstrumentSize::A8;
   case 16:
@@ -127,24 +538,55 @@ InstrumentSize AccessInstrumenter::GetInstrumentSize(llvm::Instruction &instr) {
     return InstrumentSize::A32;
   case 64:
     return InstrumentSize::A64;
+  case 128:
+    return InstrumentSize::A128;
+  case 256:
+    return InstrumentSize::A256;
+  case 512:
+    return InstrumentSize::A512;
   default:
-    // unk
-    assert(false && "Unsupported data store/load size.");
+    // Aggregates, odd-sized integers & vectors.
+    return InstrumentSize::Sized;
   }
 }
 
+llvm::Value *AccessInstrumenter::CreateAccessSize(llvm::IRBuilder<> &builder,
+                                                  llvm::Instruction &instr) {
+  // Scalable vectors are a multiple of the runtime vector scale.
+  llvm::TypeSize storeSize =
+      m_mod->getDataLayout().getTypeStoreSize(GetLoadStoreType(&instr));
+  llvm::Constant *minSize = builder.getInt64(storeSize.getKnownMinSize());
+  if (storeSize.isScalable()) {
+    return builder.CreateVScale(minSize);
+  }
+  return minSize;
+}
+
 llvm::Type *AccessInstrumenter::GetLoadStoreType(const llvm::Value *I) {
-  assert((llvm::isa<llvm::LoadInst>(I) || llvm::isa<llvm::StoreInst>(I)) &&
-         "Expected Load or Store instruction");
+  assert((llvm::isa<llvm::LoadInst>(I) || llvm::isa<llvm::StoreInst>(I) ||
+          llvm::isa<llvm::AtomicRMWInst>(I) ||
+          llvm::isa<llvm::AtomicCmpXchgInst>(I)) &&
+         "Expected Load, Store or atomic instruction");
   if (auto *LI = llvm::dyn_cast<llvm::LoadInst>(I))
     return LI->getType();
+  if (auto *RMW = llvm::dyn_cast<llvm::AtomicRMWInst>(I))
+    return RMW->getValOperand()->getType();
+  if (auto *CX = llvm::dyn_cast<llvm::AtomicCmpXchgInst>(I))
+    return CX->getNewValOperand()->getType();
   return llvm::cast<llvm::StoreInst>(I)->getValueOperand()->getType();
 }
 
 llvm::FunctionCallee AccessInstrumenter::GetInstrument(InstrumentMode mode,
                                                        InstrumentSize size) {
-  auto &dict = mode == InstrumentMode::Load ? m_loadCallees : m_storeCallees;
-  return dict[size];
+  switch (mode) {
+  case InstrumentMode::Load:
+    return m_loadCallees[size];
+  case InstrumentMode::Store:
+    return m_storeCallees[size];
+  case InstrumentMode::ReadModifyWrite:
+    return m_rmwCallees[size];
+  }
+  return nullptr;
 }
 
 void AccessInstrumenter::DeclareInstruments(llvm::LLVMContext &ctx) {
@@ -169,6 +611,85 @@ void AccessInstrumenter::DeclareInstruments(llvm::LLVMContext &ctx) {
       m_mod->getOrInsertFunction("__nxsan_report_store32", instrFuncTy);
   m_storeCallees[InstrumentSize::A64] =
       m_mod->getOrInsertFunction("__nxsan_report_store64", instrFuncTy);
+
+  m_loadCallees[InstrumentSize::A128] =
+      m_mod->getOrInsertFunction("__nxsan_report_load128", instrFuncTy);
+  m_loadCallees[InstrumentSize::A256] =
+      m_mod->getOrInsertFunction("__nxsan_report_load256", instrFuncTy);
+  m_loadCallees[InstrumentSize::A512] =
+      m_mod->getOrInsertFunction("__nxsan_report_load512", instrFuncTy);
+
+  m_storeCallees[InstrumentSize::A128] =
+      m_mod->getOrInsertFunction("__nxsan_report_store128", instrFuncTy);
+  m_storeCallees[InstrumentSize::A256] =
+      m_mod->getOrInsertFunction("__nxsan_report_store256", instrFuncTy);
+  m_storeCallees[InstrumentSize::A512] =
+      m_mod->getOrInsertFunction("__nxsan_report_store512", instrFuncTy);
+
+  m_rmwCallees[InstrumentSize::A8] =
+      m_mod->getOrInsertFunction("__nxsan_report_rmw8", instrFuncTy);
+  m_rmwCallees[InstrumentSize::A16] =
+      m_mod->getOrInsertFunction("__nxsan_report_rmw16", instrFuncTy);
+  m_rmwCallees[InstrumentSize::A32] =
+      m_mod->getOrInsertFunction("__nxsan_report_rmw32", instrFuncTy);
+  m_rmwCallees[InstrumentSize::A64] =
+      m_mod->getOrInsertFunction("__nxsan_report_rmw64", instrFuncTy);
+  m_rmwCallees[InstrumentSize::A128] =
+      m_mod->getOrInsertFunction("__nxsan_report_rmw128", instrFuncTy);
+
+  llvm::Type *rangeFuncArgs[] = {llvm::Type::getInt64Ty(ctx),
+                                 llvm::Type::getInt64Ty(ctx)};
+  llvm::FunctionType *rangeFuncTy = llvm::FunctionType::get(
+      llvm::Type::getVoidTy(ctx),
+      llvm::ArrayRef<llvm::Type *>(rangeFuncArgs, 2), false);
+  m_loadRangeCallee =
+      m_mod->getOrInsertFunction("__nxsan_report_load_range", rangeFuncTy);
+  m_storeRangeCallee =
+      m_mod->getOrInsertFunction("__nxsan_report_store_range", rangeFuncTy);
+  m_loadCallees[InstrumentSize::Sized] =
+      m_mod->getOrInsertFunction("__nxsan_report_load_n", rangeFuncTy);
+  m_storeCallees[InstrumentSize::Sized] =
+      m_mod->getOrInsertFunction("__nxsan_report_store_n", rangeFuncTy);
+  m_rmwCallees[InstrumentSize::Sized] =
+      m_mod->getOrInsertFunction("__nxsan_report_rmw_n", rangeFuncTy);
+
+  // Bulk memory operations mirror their libc signatures.
+  llvm::Type *ptrTy = llvm::Type::getInt8PtrTy(ctx);
+  llvm::Type *sizeTy = llvm::Type::getInt64Ty(ctx);
+  llvm::FunctionType *transferFuncTy =
+      llvm::FunctionType::get(ptrTy, {ptrTy, ptrTy, sizeTy}, false);
+  llvm::FunctionType *setFuncTy = llvm::FunctionType::get(
+      ptrTy, {ptrTy, llvm::Type::getInt32Ty(ctx), sizeTy}, false);
+  m_memcpyCallee = m_mod->getOrInsertFunction("__nxsan_memcpy", transferFuncTy);
+  m_memmoveCallee =
+      m_mod->getOrInsertFunction("__nxsan_memmove", transferFuncTy);
+  m_memsetCallee = m_mod->getOrInsertFunction("__nxsan_memset", setFuncTy);
+}
+
+void AccessInstrumenter::DeclareSampleGlobals(llvm::LLVMContext &ctx) {
+  // The countdown is thread local, the flags are read as raw bytes at the
+  // offset of the sample rate.
+  m_sampleCountdownGlobal = m_mod->getOrInsertGlobal(
+      "__nxsan_sample_countdown", llvm::Type::getInt64Ty(ctx), [&] {
+        return new llvm::GlobalVariable(
+            *m_mod, llvm::Type::getInt64Ty(ctx), false,
+            llvm::GlobalValue::ExternalLinkage, nullptr,
+            "__nxsan_sample_countdown", nullptr,
+            llvm::GlobalValue::InitialExecTLSModel);
+      });
+  m_flagsGlobal = m_mod->getOrInsertGlobal(
+      "__nxsan_flags",
+      llvm::ArrayType::get(llvm::Type::getInt8Ty(ctx),
+                           sizeof(__nxsan_flags_t)));
+}
+
+void AccessInstrumenter::DeclareShadowGlobals(llvm::LLVMContext &ctx) {
+  m_shadowGlobal =
+      m_mod->getOrInsertGlobal("__nxsan_shadow", llvm::Type::getInt8PtrTy(ctx));
+  m_heapBaseGlobal = m_mod->getOrInsertGlobal("__nxsan_heap_base",
+                                              llvm::Type::getInt8PtrTy(ctx));
+  m_shadowSizeGlobal = m_mod->getOrInsertGlobal("__nxsan_shadow_size",
+                                                llvm::Type::getInt64Ty(ctx));
 }
 
 } // namespace nxsan
@@ -1,5 +1,6 @@
 #include "instrumentation/CliArguments.hpp"
 
+#include <cstdlib>
 #include <iostream>
 
 namespace nxsan {
@@ -48,7 +49,7 @@ void CliArguments::PrintManual() {
   std::cout << "OVERVIEW: nxsan instrumentation tool" << std::endl;
   std::cout << std::endl;
   std::cout << "Generates instrumentation function calls to the nxsan runtime" << std::endl;
-  std::cout << "for all store and load instructions to memory." << std::endl;
+  std::cout << "for all load, store and atomic instructions to memory." << std::endl;
   std::cout << std::endl;
 
   // Usage.
@@ -57,14 +58,34 @@ void CliArguments::PrintManual() {
 
   // Options.
   std::cout << "OPTIONS:" << std::endl;
+  std::cout << "  --format <ll|bc>" << std::endl;
+  std::cout << "      Output IR format. Defaults to bitcode for '.bc' outputs, textual IR otherwise." << std::endl;
   std::cout << "  --help" << std::endl;
   std::cout << "      Prints this usage manual." << std::endl;
+  std::cout << "  --inline-checks" << std::endl;
+  std::cout << "      Emits the shadow tag check inline, only calling into the runtime on a mismatch." << std::endl;
+  std::cout << "  --jobs <N>" << std::endl;
+  std::cout << "      Number of input files to instrument in parallel. Defaults to 1." << std::endl;
+  std::cout << "  --no-bulk-checks" << std::endl;
+  std::cout << "      Leaves memcpy, memmove & memset unchecked, rather than verifying their whole ranges." << std::endl;
+  std::cout << "  --no-coalesce" << std::endl;
+  std::cout << "      Disables merging checks of nearby accesses from the same pointer into a single range check." << std::endl;
+  std::cout << "  --no-check-elim" << std::endl;
+  std::cout << "      Disables removal of checks made redundant by a dominating check." << std::endl;
+  std::cout << "  --no-heap-elim" << std::endl;
+  std::cout << "      Disables removal of checks on accesses to stack objects & globals, which are never tagged." << std::endl;
+  std::cout << "  --no-loop-hoist" << std::endl;
+  std::cout << "      Disables replacing checks of affine accesses in loops with a single range check." << std::endl;
   std::cout << "  --out" << std::endl;
   std::cout << "      Output file pattern. The original file name will be substituted where '{}' is present." << std::endl;
+  std::cout << "  --sample-checks" << std::endl;
+  std::cout << "      Emits the runtime's sampling countdown inline, so accesses skipped by sampling never call the runtime. Range checks hoisted out of loops are not sampled." << std::endl;
+  std::cout << "  --stats" << std::endl;
+  std::cout << "      Prints the number of instrumented loads, stores & bulk operations, removed, hoisted, elided & coalesced checks for each file." << std::endl;
 
 }
 
-std::string CliArguments::GetOutFileName(const std::string& inFileName) {
+std::string CliArguments::GetOutFileName(const std::string& inFileName) const {
   std::string outFileName = GetOutFileFormat();
   std::string token = "{}";
 
@@ -77,6 +98,17 @@ std::string CliArguments::GetOutFileName(const std::string& inFileName) {
   return outFileName;
 }
 
+IrFormat CliArguments::GetOutIrFormat(const std::string &outFileName) const {
+  if (m_irFormat.has_value()) {
+    return m_irFormat.value();
+  }
+  std::string ext = ".bc";
+  bool isBitcode = outFileName.size() >= ext.size() &&
+                   outFileName.compare(outFileName.size() - ext.size(),
+                                       ext.size(), ext) == 0;
+  return isBitcode ? IrFormat::Bitcode : IrFormat::Text;
+}
+
 NxsResult<bool, std::string>
 CliArguments::ParseOpt(std::string opt, std::optional<std::string> next) {
   // Output file.
@@ -88,6 +120,84 @@ CliArguments::ParseOpt(std::string opt, std::optional<std::string> next) {
     return true;
   }
 
+  // Output IR format.
+  if (opt == "format") {
+    if (!next.has_value()) {
+      return "No value provided for option '--format'.";
+    }
+    if (next.value() == "ll") {
+      m_irFormat = IrFormat::Text;
+    } else if (next.value() == "bc") {
+      m_irFormat = IrFormat::Bitcode;
+    } else {
+      return std::string("Unknown output format '") + next.value() + "'.";
+    }
+    return true;
+  }
+
+  // Number of parallel jobs.
+  if (opt == "jobs") {
+    if (!next.has_value()) {
+      return "No value provided for option '--jobs'.";
+    }
+    const std::string &value = next.value();
+    bool numeric = !value.empty() &&
+                   value.find_first_not_of("0123456789") == std::string::npos;
+    m_numJobs = numeric ? std::strtoul(value.c_str(), nullptr, 10) : 0;
+    if (m_numJobs < 1) {
+      return std::string("Invalid number of jobs '") + value + "'.";
+    }
+    return true;
+  }
+
+  // Inline shadow checks.
+  if (opt == "inline-checks") {
+    m_options.inlineChecks = true;
+    return false;
+  }
+
+  // Sampled checks.
+  if (opt == "sample-checks") {
+    m_options.sampleChecks = true;
+    return false;
+  }
+
+  // Redundant check elimination.
+  if (opt == "no-check-elim") {
+    m_options.eliminateRedundantChecks = false;
+    return false;
+  }
+
+  // Bulk memory operation checks.
+  if (opt == "no-bulk-checks") {
+    m_options.instrumentBulkOps = false;
+    return false;
+  }
+
+  // Non-heap check elision.
+  if (opt == "no-heap-elim") {
+    m_options.elideNonHeapChecks = false;
+    return false;
+  }
+
+  // Check coalescing.
+  if (opt == "no-coalesce") {
+    m_options.coalesceChecks = false;
+    return false;
+  }
+
+  // Loop check hoisting.
+  if (opt == "no-loop-hoist") {
+    m_options.hoistLoopChecks = false;
+    return false;
+  }
+
+  // Instrumentation statistics.
+  if (opt == "stats") {
+    m_printStats = true;
+    return false;
+  }
+
   // Manual.
   if (opt == "help") {
     m_printHelp = true;
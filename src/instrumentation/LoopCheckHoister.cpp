@@ -0,0 +1,133 @@
+#include "instrumentation/LoopCheckHoister.hpp"
+#include "instrumentation/RedundantCheckEliminator.hpp"
+
+#include <llvm/ADT/Triple.h>
+#include <llvm/Analysis/ScalarEvolutionExpressions.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/Support/Casting.h>
+#include <llvm/Transforms/Utils/ScalarEvolutionExpander.h>
+
+namespace nxsan {
+
+LoopCheckHoister::LoopCheckHoister(llvm::Function &func,
+                                   const llvm::DataLayout &layout)
+    : m_func(func), m_layout(layout),
+      m_tlii(llvm::Triple(func.getParent()->getTargetTriple())), m_tli(m_tlii),
+      m_assumptions(func), m_domTree(func), m_loopInfo(m_domTree),
+      m_scev(func, m_tli, m_assumptions, m_domTree, m_loopInfo) {}
+
+void LoopCheckHoister::Run(const std::vector<llvm::Instruction *> &accesses,
+                           llvm::FunctionCallee loadRange,
+                           llvm::FunctionCallee storeRange) {
+  m_hoisted.clear();
+  m_emitted.clear();
+  for (llvm::Instruction *inst : accesses) {
+    if (TryHoist(inst, loadRange, storeRange)) {
+      m_hoisted.insert(inst);
+    }
+  }
+}
+
+bool LoopCheckHoister::TryHoist(llvm::Instruction *inst,
+                                llvm::FunctionCallee loadRange,
+                                llvm::FunctionCallee storeRange) {
+  // The access must be within a loop in simplified form, where the latch is
+  // the only exit. The access must also execute on every iteration, and no
+  // memory may be freed while the loop runs.
+  llvm::Loop *loop = m_loopInfo.getLoopFor(inst->getParent());
+  if (!loop) {
+    return false;
+  }
+  llvm::BasicBlock *preheader = loop->getLoopPreheader();
+  llvm::BasicBlock *latch = loop->getLoopLatch();
+  if (!preheader || !latch || loop->getExitingBlock() != latch ||
+      !m_domTree.dominates(inst->getParent(), latch) || LoopMayFree(loop)) {
+    return false;
+  }
+
+  // The accessed address must be an affine recurrence with a constant stride.
+  // Atomic read-modify-writes are left to be checked in place.
+  llvm::Value *ptr = llvm::getLoadStorePointerOperand(inst);
+  if (!ptr) {
+    return false;
+  }
+  auto *rec = llvm::dyn_cast<llvm::SCEVAddRecExpr>(m_scev.getSCEV(ptr));
+  if (!rec || rec->getLoop() != loop || !rec->isAffine()) {
+    return false;
+  }
+  auto *stride = llvm::dyn_cast<llvm::SCEVConstant>(rec->getStepRecurrence(m_scev));
+  if (!stride) {
+    return false;
+  }
+
+  // The loop must run a computable number of iterations.
+  const llvm::SCEV *backedges = m_scev.getBackedgeTakenCount(loop);
+  if (llvm::isa<llvm::SCEVCouldNotCompute>(backedges)) {
+    return false;
+  }
+
+  // Compute the range [low, low + len) covered by all iterations.
+  const llvm::SCEV *first = rec->getStart();
+  const llvm::SCEV *last = rec->evaluateAtIteration(backedges, m_scev);
+  bool descending = stride->getAPInt().isNegative();
+  const llvm::SCEV *low = descending ? last : first;
+  const llvm::SCEV *high = descending ? first : last;
+  const llvm::SCEV *span = m_scev.getMinusSCEV(high, low);
+  if (llvm::isa<llvm::SCEVCouldNotCompute>(span)) {
+    return false;
+  }
+  llvm::TypeSize storeSize =
+      m_layout.getTypeStoreSize(llvm::getLoadStoreType(inst));
+  if (storeSize.isScalable()) {
+    return false;
+  }
+  uint64_t size = storeSize.getFixedSize();
+  llvm::Type *i64Ty = llvm::Type::getInt64Ty(m_func.getContext());
+  const llvm::SCEV *len = m_scev.getTruncateOrZeroExtend(
+      m_scev.getAddExpr(span, m_scev.getConstant(span->getType(), size)),
+      i64Ty);
+
+  llvm::Instruction *insertPt = preheader->getTerminator();
+  if (!llvm::isSafeToExpandAt(low, insertPt, m_scev) ||
+      !llvm::isSafeToExpandAt(len, insertPt, m_scev)) {
+    return false;
+  }
+
+  // Emit the range check, unless an identical one already exists.
+  bool isStore = llvm::isa<llvm::StoreInst>(inst);
+  if (!m_emitted.insert({loop, low, len, isStore}).second) {
+    return true;
+  }
+  llvm::SCEVExpander expander(m_scev, m_layout, "nxsan.range");
+  llvm::Value *lowPtr = expander.expandCodeFor(low, low->getType(), insertPt);
+  llvm::Value *lenVal = expander.expandCodeFor(len, i64Ty, insertPt);
+
+  llvm::IRBuilder<> builder(insertPt);
+  llvm::Value *args[] = {builder.CreatePtrToInt(lowPtr, i64Ty), lenVal};
+  builder.CreateCall(isStore ? storeRange : loadRange, args);
+  return true;
+}
+
+bool LoopCheckHoister::LoopMayFree(llvm::Loop *loop) {
+  auto it = m_loopMayFree.find(loop);
+  if (it != m_loopMayFree.end()) {
+    return it->second;
+  }
+
+  bool mayFree = false;
+  for (llvm::BasicBlock *bb : loop->blocks()) {
+    for (llvm::Instruction &inst : *bb) {
+      if (RedundantCheckEliminator::MayFree(inst)) {
+        mayFree = true;
+        break;
+      }
+    }
+    if (mayFree) {
+      break;
+    }
+  }
+  m_loopMayFree[loop] = mayFree;
+  return mayFree;
+}
+
+} // namespace nxsan
@@ -0,0 +1,21 @@
+#include "instrumentation/NxsanPass.hpp"
+#include "instrumentation/AccessInstrumenter.hpp"
+
+namespace nxsan {
+
+NxsanPass::NxsanPass(const InstrumenterOptions &options)
+    : m_options(options) {}
+
+llvm::PreservedAnalyses NxsanPass::run(llvm::Module &mod,
+                                       llvm::ModuleAnalysisManager &) {
+  AccessInstrumenter acins(m_options);
+  InstrumentedIr stats = acins.InstrumentModule(mod);
+
+  // Declaring the instruments alone does not invalidate any analyses.
+  if (!stats.modified) {
+    return llvm::PreservedAnalyses::all();
+  }
+  return llvm::PreservedAnalyses::none();
+}
+
+} // namespace nxsan
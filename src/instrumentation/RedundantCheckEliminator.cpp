@@ -0,0 +1,145 @@
+#include "instrumentation/RedundantCheckEliminator.hpp"
+
+#include <llvm/Analysis/ValueTracking.h>
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/IntrinsicInst.h>
+#include <llvm/Support/Casting.h>
+#include <utility>
+
+namespace nxsan {
+
+RedundantCheckEliminator::RedundantCheckEliminator(
+    llvm::Function &func, const llvm::DataLayout &layout)
+    : m_func(func), m_layout(layout), m_domTree(func) {}
+
+void RedundantCheckEliminator::Run(
+    const std::vector<llvm::Instruction *> &accesses) {
+  m_accesses = std::unordered_set<llvm::Instruction *>(accesses.begin(),
+                                                       accesses.end());
+  m_redundant.clear();
+  if (m_func.empty()) {
+    return;
+  }
+
+  // Walk the dominator tree, carrying the checks available at the end of each
+  // block down to the blocks it immediately dominates.
+  std::vector<std::pair<llvm::DomTreeNode *, std::vector<AvailableCheck>>>
+      worklist;
+  worklist.push_back({m_domTree.getRootNode(), {}});
+  while (!worklist.empty()) {
+    auto [node, available] = std::move(worklist.back());
+    worklist.pop_back();
+
+    llvm::BasicBlock *bb = node->getBlock();
+    ProcessBlock(*bb, available);
+
+    for (llvm::DomTreeNode *child : node->children()) {
+      // Checks only carry over if nothing between the two blocks may free.
+      if (PathMayFree(bb, child->getBlock())) {
+        worklist.push_back({child, {}});
+      } else {
+        worklist.push_back({child, available});
+      }
+    }
+  }
+}
+
+void RedundantCheckEliminator::ProcessBlock(
+    llvm::BasicBlock &bb, std::vector<AvailableCheck> &available) {
+  for (llvm::Instruction &inst : bb) {
+    // Any call which may free memory invalidates all prior checks.
+    if (MayFree(inst)) {
+      available.clear();
+      continue;
+    }
+    if (m_accesses.count(&inst) == 0) {
+      continue;
+    }
+
+    // Decompose the accessed pointer into a base & constant offset. Atomic
+    // read-modify-writes & accesses of scalable vectors are always checked.
+    llvm::Value *ptr = llvm::getLoadStorePointerOperand(&inst);
+    if (!ptr) {
+      continue;
+    }
+    llvm::Type *type = llvm::getLoadStoreType(&inst);
+    if (m_layout.getTypeStoreSize(type).isScalable()) {
+      continue;
+    }
+    AvailableCheck check;
+    check.offset = 0;
+    check.base =
+        llvm::GetPointerBaseWithConstantOffset(ptr, check.offset, m_layout);
+    check.size = m_layout.getTypeStoreSize(type).getFixedSize();
+
+    // Is there a prior check covering all bytes of this access?
+    bool covered = false;
+    for (const AvailableCheck &prior : available) {
+      if (prior.base == check.base && prior.offset <= check.offset &&
+          check.offset + (int64_t)check.size <=
+              prior.offset + (int64_t)prior.size) {
+        covered = true;
+        break;
+      }
+    }
+
+    if (covered) {
+      m_redundant.insert(&inst);
+    } else {
+      available.push_back(check);
+    }
+  }
+}
+
+bool RedundantCheckEliminator::PathMayFree(llvm::BasicBlock *from,
+                                           llvm::BasicBlock *to) {
+  // Walk backwards from the target to its immediate dominator, looking for any
+  // intermediate block which may free memory. If the target is reachable from
+  // itself without passing through the dominator, its own calls also count.
+  std::unordered_set<llvm::BasicBlock *> visited;
+  std::vector<llvm::BasicBlock *> worklist(llvm::pred_begin(to),
+                                           llvm::pred_end(to));
+  while (!worklist.empty()) {
+    llvm::BasicBlock *bb = worklist.back();
+    worklist.pop_back();
+    if (bb == from || !visited.insert(bb).second) {
+      continue;
+    }
+    if (BlockMayFree(*bb)) {
+      return true;
+    }
+    worklist.insert(worklist.end(), llvm::pred_begin(bb), llvm::pred_end(bb));
+  }
+  return false;
+}
+
+bool RedundantCheckEliminator::BlockMayFree(llvm::BasicBlock &bb) {
+  for (llvm::Instruction &inst : bb) {
+    if (MayFree(inst)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool RedundantCheckEliminator::MayFree(llvm::Instruction &inst) {
+  auto *call = llvm::dyn_cast<llvm::CallBase>(&inst);
+  if (!call) {
+    return false;
+  }
+
+  // Intrinsics & calls known not to free are safe.
+  if (llvm::isa<llvm::IntrinsicInst>(call) ||
+      call->hasFnAttr(llvm::Attribute::NoFree)) {
+    return false;
+  }
+
+  // Existing nxsan checks never free memory.
+  llvm::Function *callee = call->getCalledFunction();
+  if (callee && callee->getName().startswith("__nxsan_report")) {
+    return false;
+  }
+  return true;
+}
+
+} // namespace nxsan
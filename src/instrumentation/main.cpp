@@ -1,10 +1,27 @@
+#include <algorithm>
+#include <atomic>
 #include <filesystem>
-#include <fstream>
 #include <iostream>
+#include <thread>
+#include <vector>
 
 #include "instrumentation/AccessInstrumenter.hpp"
 #include "instrumentation/CliArguments.hpp"
 
+// Instruments a single input file, writing the output next to it.
+// Returns instrumentation statistics, or an error message on failure.
+static nxsan::NxsResult<nxsan::InstrumentedIr, std::string>
+InstrumentFile(const nxsan::CliArguments &args, const std::string &inputFile) {
+  // Get the output file path to write to.
+  std::filesystem::path inputPath = inputFile;
+  std::string outputName = args.GetOutFileName(inputPath.filename().replace_extension());
+  std::filesystem::path outPath = inputPath.replace_filename(outputName);
+
+  // Create instrumenter, run it on input file & stream the IR to file.
+  nxsan::AccessInstrumenter acins(args.GetInstrumenterOptions());
+  return acins.GenerateIR(inputFile, outPath, args.GetOutIrFormat(outputName));
+}
+
 int main(int argc, char **argv) {
   // Parse CLI arguments.
   auto argsRes = nxsan::CliArguments::Parse(argc, argv);
@@ -21,31 +38,45 @@ int main(int argc, char **argv) {
       return 0;
   }
 
-  // For each input file, attempt to parse LLVM.
-  for (auto &inputFile : args.GetInputFiles()) {
-    // Create instrumenter, run it on input file.
-    nxsan::AccessInstrumenter acins(inputFile);
-    auto result = acins.GenerateIR();
-
-    // If there was an error instrumenting, report that.
-    if (result.HasError()) {
-      std::cout << "nxsan-instrumentation-cxx: " << result.Error() << std::endl;
-      continue;
+  // Instrument input files across a pool of workers, each with its own
+  // instrumenter (and so LLVM context). Errors are collected per file so they
+  // can be reported in input order once all workers have finished.
+  const std::vector<std::string> &inputFiles = args.GetInputFiles();
+  std::vector<nxsan::NxsError> errors(inputFiles.size());
+  std::vector<std::optional<nxsan::InstrumentedIr>> stats(inputFiles.size());
+  std::atomic<size_t> nextFile{0};
+  auto worker = [&]() {
+    for (size_t i = nextFile++; i < inputFiles.size(); i = nextFile++) {
+      auto result = InstrumentFile(args, inputFiles[i]);
+      if (result.HasError()) {
+        errors[i] = result.Error();
+      } else {
+        stats[i] = result.Result();
+      }
     }
+  };
 
-    // Get the output file path to write to.
-    std::filesystem::path inputPath = inputFile;
-    std::string outputName = args.GetOutFileName(inputPath.filename().replace_extension());
-    std::filesystem::path outPath = inputPath.replace_filename(outputName);
-
-    // Write the IR to file.
-    {
-      std::ofstream ostr(outPath, std::ios::trunc);
-      if (!ostr.is_open()) {
-        std::cout << "nxsan-instrumentation-cxx: Failed to open output file stream." << std::endl;
-        continue;
-      }
-      ostr << result.Result().ir;
+  size_t numJobs = std::min(args.GetNumJobs(), inputFiles.size());
+  std::vector<std::thread> pool;
+  for (size_t i = 1; i < numJobs; i++) {
+    pool.emplace_back(worker);
+  }
+  worker();
+  for (auto &thread : pool) {
+    thread.join();
+  }
+
+  // Report errors, and statistics if requested.
+  for (size_t i = 0; i < inputFiles.size(); i++) {
+    if (errors[i].has_value()) {
+      std::cout << "nxsan-instrumentation-cxx: " << errors[i].value() << std::endl;
+    } else if (args.IsStatsRequested()) {
+      const nxsan::InstrumentedIr &fileStats = stats[i].value();
+      std::cout << "nxsan-stats: " << inputFiles[i] << " loads=" << fileStats.numLoads
+                << " stores=" << fileStats.numStores << " removed=" << fileStats.numRemovedChecks
+                << " hoisted=" << fileStats.numHoistedChecks << " bulk=" << fileStats.numBulkOps
+                << " elided=" << fileStats.numElidedChecks
+                << " coalesced=" << fileStats.numCoalescedChecks << std::endl;
     }
   }
 
@@ -0,0 +1,92 @@
+#include <llvm/Passes/PassBuilder.h>
+#include <llvm/Passes/PassPlugin.h>
+#include <llvm/Support/CommandLine.h>
+
+#include "instrumentation/NxsanPass.hpp"
+
+// Options for the plugin, available through '-mllvm' (clang) or directly (opt)
+// when the plugin is also loaded as a legacy plugin with '-load'.
+enum class PipelinePoint { PipelineStart, OptimizerLast };
+
+// clang-format off
+static llvm::cl::opt<PipelinePoint> NxsanPipelinePoint(
+    "nxsan-pipeline-point",
+    llvm::cl::desc("Point in the default pipelines to instrument at."),
+    llvm::cl::values(
+        clEnumValN(PipelinePoint::PipelineStart, "pipeline-start", "Before any optimization."),
+        clEnumValN(PipelinePoint::OptimizerLast, "optimizer-last", "After optimization, so fewer accesses survive.")),
+    llvm::cl::init(PipelinePoint::OptimizerLast));
+static llvm::cl::opt<bool> NxsanInlineChecks(
+    "nxsan-inline-checks",
+    llvm::cl::desc("Emit the shadow tag check inline, only calling into the runtime on a mismatch."),
+    llvm::cl::init(false));
+static llvm::cl::opt<bool> NxsanSampleChecks(
+    "nxsan-sample-checks",
+    llvm::cl::desc("Emit the runtime's sampling countdown inline, so accesses skipped by sampling never call the runtime. Range checks hoisted out of loops are not sampled."),
+    llvm::cl::init(false));
+static llvm::cl::opt<bool> NxsanNoCheckElim(
+    "nxsan-no-check-elim",
+    llvm::cl::desc("Disable removal of checks made redundant by a dominating check."),
+    llvm::cl::init(false));
+static llvm::cl::opt<bool> NxsanNoHeapElim(
+    "nxsan-no-heap-elim",
+    llvm::cl::desc("Disable removal of checks on accesses to stack objects & globals, which are never tagged."),
+    llvm::cl::init(false));
+static llvm::cl::opt<bool> NxsanNoLoopHoist(
+    "nxsan-no-loop-hoist",
+    llvm::cl::desc("Disable replacing checks of affine accesses in loops with a single range check."),
+    llvm::cl::init(false));
+static llvm::cl::opt<bool> NxsanNoCoalesce(
+    "nxsan-no-coalesce",
+    llvm::cl::desc("Disable merging checks of nearby accesses from the same pointer into a single range check."),
+    llvm::cl::init(false));
+static llvm::cl::opt<bool> NxsanNoBulkChecks(
+    "nxsan-no-bulk-checks",
+    llvm::cl::desc("Leave memcpy, memmove & memset unchecked, rather than verifying their whole ranges."),
+    llvm::cl::init(false));
+// clang-format on
+
+// Builds instrumenter options from the command line options.
+static nxsan::InstrumenterOptions GetOptions() {
+  nxsan::InstrumenterOptions options;
+  options.inlineChecks = NxsanInlineChecks;
+  options.sampleChecks = NxsanSampleChecks;
+  options.elideNonHeapChecks = !NxsanNoHeapElim;
+  options.eliminateRedundantChecks = !NxsanNoCheckElim;
+  options.hoistLoopChecks = !NxsanNoLoopHoist;
+  options.coalesceChecks = !NxsanNoCoalesce;
+  options.instrumentBulkOps = !NxsanNoBulkChecks;
+  return options;
+}
+
+// Registers the pass with the pass builder, both as a named pipeline element
+// ('-passes=nxsan') and at the configured point of the default pipelines.
+static void RegisterNxsanPass(llvm::PassBuilder &pb) {
+  pb.registerPipelineParsingCallback(
+      [](llvm::StringRef name, llvm::ModulePassManager &mpm,
+         llvm::ArrayRef<llvm::PassBuilder::PipelineElement>) {
+        if (name != "nxsan") {
+          return false;
+        }
+        mpm.addPass(nxsan::NxsanPass(GetOptions()));
+        return true;
+      });
+
+  if (NxsanPipelinePoint == PipelinePoint::PipelineStart) {
+    pb.registerPipelineStartEPCallback(
+        [](llvm::ModulePassManager &mpm, llvm::OptimizationLevel) {
+          mpm.addPass(nxsan::NxsanPass(GetOptions()));
+        });
+  } else {
+    pb.registerOptimizerLastEPCallback(
+        [](llvm::ModulePassManager &mpm, llvm::OptimizationLevel) {
+          mpm.addPass(nxsan::NxsanPass(GetOptions()));
+        });
+  }
+}
+
+extern "C" LLVM_ATTRIBUTE_WEAK ::llvm::PassPluginLibraryInfo
+llvmGetPassPluginInfo() {
+  return {LLVM_PLUGIN_API_VERSION, "nxsan", LLVM_VERSION_STRING,
+          RegisterNxsanPass};
+}
@@ -0,0 +1,412 @@
+#include "runtime/nxsan_internal.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <sys/mman.h>
+#include <vector>
+
+// Older C libraries may not define this. Kernels which do not support it treat
+// the address as a hint, which is handled below.
+#ifndef MAP_FIXED_NOREPLACE
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+
+// Size of each span reserved from the tracked heap. A span either holds chunks
+// of a single size class, or is part of a run of spans for a large allocation.
+#define __NXSAN_SPAN_SIZE_BYTES (64 * 1024)
+
+// Largest allocation served from a size class. Larger allocations are given
+// their own run of spans.
+#define __NXSAN_MAX_SMALL_SIZE (16 * 1024)
+
+// Size classes are one per granule up to 256 bytes, then four per doubling up
+// to the largest small allocation (256, 512] ... (8192, 16384].
+#define __NXSAN_NUM_LINEAR_CLASSES 16
+#define __NXSAN_NUM_SIZE_CLASSES (__NXSAN_NUM_LINEAR_CLASSES + 6 * 4)
+#define __NXSAN_LARGE_CLASS __NXSAN_NUM_SIZE_CLASSES
+
+// Number of chunks moved between a thread cache and a central free-list at
+// once. Thread caches hold at most twice this many chunks per class.
+#define __NXSAN_CACHE_BATCH 32
+
+// A span of tracked heap memory owned by the allocator, with a metadata entry
+// for each chunk.
+struct __nxsan_span {
+  uint8_t *base;
+  size_t size;
+  size_t chunkSize;
+  size_t sizeClass;
+  __nxsan_chunk_meta *meta;
+};
+
+// A chunk sitting on a free-list. The link is stored in the chunk itself.
+struct __nxsan_free_chunk {
+  __nxsan_free_chunk *next;
+};
+
+// Central free-list for a single size class.
+struct __nxsan_central_list {
+  std::mutex lock;
+  __nxsan_free_chunk *head = nullptr;
+};
+
+// Per-thread free-lists. Chunks may be freed by a different thread than
+// allocated them, moving between caches through the central free-lists.
+struct __nxsan_thread_cache {
+  uint64_t generation = 0;
+  __nxsan_free_chunk *lists[__NXSAN_NUM_SIZE_CLASSES] = {};
+  size_t counts[__NXSAN_NUM_SIZE_CLASSES] = {};
+  ~__nxsan_thread_cache();
+};
+
+// Region state, guarded by the region lock. Spans are never returned to the
+// OS until termination, so the span table only ever gains entries.
+static std::mutex __nxsan_region_lock;
+static uint8_t *__nxsan_region_cursor = nullptr;
+static uint8_t *__nxsan_span_base = nullptr;
+static __nxsan_span **__nxsan_span_table = nullptr;
+static size_t __nxsan_span_table_size = 0;
+static std::vector<__nxsan_span *> __nxsan_spans;
+static size_t __nxsan_reserved_bytes = 0;
+static std::multimap<size_t, __nxsan_span *> __nxsan_free_large;
+
+// Central free-lists, one per size class.
+static __nxsan_central_list __nxsan_central[__NXSAN_NUM_SIZE_CLASSES];
+
+// Incremented on every init/terminate, invalidating all thread caches.
+static std::atomic<uint64_t> __nxsan_alloc_generation{0};
+static thread_local __nxsan_thread_cache __nxsan_tcache;
+
+// Returns the size class for a small allocation size.
+static inline __attribute__((always_inline)) size_t
+__nxsan_size_class(size_t size) {
+  if (size <= __NXSAN_NUM_LINEAR_CLASSES * __NXSAN_TAG_GRANULARITY_BYTES) {
+    return (size + __NXSAN_TAG_GRANULARITY_BYTES - 1) /
+               __NXSAN_TAG_GRANULARITY_BYTES -
+           1;
+  }
+  size_t log2 = 63 - __builtin_clzll(size - 1);
+  size_t step = (size_t)1 << (log2 - 2);
+  return __NXSAN_NUM_LINEAR_CLASSES + (log2 - 8) * 4 +
+         (size - ((size_t)1 << log2) + step - 1) / step - 1;
+}
+
+// Returns the chunk size for a given size class.
+static inline __attribute__((always_inline)) size_t
+__nxsan_class_size(size_t sizeClass) {
+  if (sizeClass < __NXSAN_NUM_LINEAR_CLASSES) {
+    return (sizeClass + 1) * __NXSAN_TAG_GRANULARITY_BYTES;
+  }
+  size_t log2 = (sizeClass - __NXSAN_NUM_LINEAR_CLASSES) / 4 + 8;
+  size_t sub = (sizeClass - __NXSAN_NUM_LINEAR_CLASSES) % 4 + 1;
+  return ((size_t)1 << log2) + sub * ((size_t)1 << (log2 - 2));
+}
+
+// Fetches the span containing the given (untagged) pointer, if any.
+static inline __attribute__((always_inline)) __nxsan_span *
+__nxsan_region_lookup(void *ptr) {
+  if ((uint8_t *)ptr < __nxsan_span_base) {
+    return nullptr;
+  }
+  size_t idx = ((uint8_t *)ptr - __nxsan_span_base) / __NXSAN_SPAN_SIZE_BYTES;
+  if (idx >= __nxsan_span_table_size) {
+    return nullptr;
+  }
+  return __atomic_load_n(&__nxsan_span_table[idx], __ATOMIC_ACQUIRE);
+}
+
+// Reserves a run of spans of the given size from the tracked heap, skipping
+// over any address ranges which are already mapped. Region lock must be held.
+static __nxsan_span *__nxsan_reserve_spans(size_t size, size_t sizeClass,
+                                           size_t chunkSize) {
+  uint8_t *tail = __nxsan_span_base +
+                  __nxsan_span_table_size * __NXSAN_SPAN_SIZE_BYTES;
+  while (__nxsan_region_cursor < tail &&
+         size <= (size_t)(tail - __nxsan_region_cursor)) {
+    void *want = __nxsan_region_cursor;
+    void *got = mmap(want, size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE |
+                         MAP_FIXED_NOREPLACE,
+                     -1, 0);
+    if (got == want) {
+      size_t numChunks = sizeClass == __NXSAN_LARGE_CLASS ? 1 : size / chunkSize;
+      __nxsan_span *span =
+          new __nxsan_span{(uint8_t *)got, size, chunkSize, sizeClass,
+                           new __nxsan_chunk_meta[numChunks]()};
+      __nxsan_spans.push_back(span);
+      __nxsan_reserved_bytes += size;
+      size_t idx = (span->base - __nxsan_span_base) / __NXSAN_SPAN_SIZE_BYTES;
+      for (size_t i = 0; i < size / __NXSAN_SPAN_SIZE_BYTES; i++) {
+        __atomic_store_n(&__nxsan_span_table[idx + i], span, __ATOMIC_RELEASE);
+      }
+      __nxsan_region_cursor += size;
+      return span;
+    }
+
+    // The range is in use. If the kernel treated the address as a hint, it may
+    // have mapped elsewhere, so release that before moving on.
+    if (got != MAP_FAILED) {
+      munmap(got, size);
+    }
+    __nxsan_region_cursor += __NXSAN_SPAN_SIZE_BYTES;
+  }
+  return nullptr;
+}
+
+// Allocates a large chunk from its own run of spans, reusing a released run
+// of a similar size where possible.
+static void *__nxsan_alloc_large(size_t size, __nxsan_chunk_meta **meta) {
+  if (size > SIZE_MAX - __NXSAN_SPAN_SIZE_BYTES) {
+    return nullptr;
+  }
+  size_t runSize = (size + __NXSAN_SPAN_SIZE_BYTES - 1) /
+                   __NXSAN_SPAN_SIZE_BYTES * __NXSAN_SPAN_SIZE_BYTES;
+
+  std::lock_guard<std::mutex> guard(__nxsan_region_lock);
+  auto it = __nxsan_free_large.lower_bound(runSize);
+  if (it != __nxsan_free_large.end() && it->first <= runSize * 2) {
+    __nxsan_span *span = it->second;
+    __nxsan_free_large.erase(it);
+    span->chunkSize = size;
+    *meta = span->meta;
+    return span->base;
+  }
+
+  __nxsan_span *span = __nxsan_reserve_spans(runSize, __NXSAN_LARGE_CLASS, size);
+  if (!span) {
+    return nullptr;
+  }
+  *meta = span->meta;
+  return span->base;
+}
+
+// Moves up to a batch of chunks from the central free-list into the given
+// thread cache, carving a new span if the central free-list is empty.
+static bool __nxsan_refill_cache(__nxsan_thread_cache &cache,
+                                 size_t sizeClass) {
+  __nxsan_central_list &central = __nxsan_central[sizeClass];
+  std::lock_guard<std::mutex> guard(central.lock);
+
+  // Carve a fresh span into the central free-list if required.
+  if (!central.head) {
+    size_t chunkSize = __nxsan_class_size(sizeClass);
+    __nxsan_span *span;
+    {
+      std::lock_guard<std::mutex> regionGuard(__nxsan_region_lock);
+      span = __nxsan_reserve_spans(__NXSAN_SPAN_SIZE_BYTES, sizeClass,
+                                   chunkSize);
+    }
+    if (!span) {
+      return false;
+    }
+    size_t numChunks = span->size / chunkSize;
+    for (size_t i = numChunks; i > 0; i--) {
+      auto *chunk =
+          (__nxsan_free_chunk *)(span->base + (i - 1) * chunkSize);
+      chunk->next = central.head;
+      central.head = chunk;
+    }
+  }
+
+  for (size_t i = 0; i < __NXSAN_CACHE_BATCH && central.head; i++) {
+    __nxsan_free_chunk *chunk = central.head;
+    central.head = chunk->next;
+    chunk->next = cache.lists[sizeClass];
+    cache.lists[sizeClass] = chunk;
+    cache.counts[sizeClass]++;
+  }
+  return true;
+}
+
+// Moves up to the given number of chunks from a thread cache back to the
+// central free-list.
+static void __nxsan_drain_cache(__nxsan_thread_cache &cache, size_t sizeClass,
+                                size_t count) {
+  __nxsan_central_list &central = __nxsan_central[sizeClass];
+  std::lock_guard<std::mutex> guard(central.lock);
+  for (size_t i = 0; i < count && cache.lists[sizeClass]; i++) {
+    __nxsan_free_chunk *chunk = cache.lists[sizeClass];
+    cache.lists[sizeClass] = chunk->next;
+    cache.counts[sizeClass]--;
+    chunk->next = central.head;
+    central.head = chunk;
+  }
+}
+
+__nxsan_thread_cache::~__nxsan_thread_cache() {
+  // Return cached chunks, unless they belong to a previous initialisation.
+  if (generation != __nxsan_alloc_generation.load(std::memory_order_relaxed)) {
+    return;
+  }
+  for (size_t i = 0; i < __NXSAN_NUM_SIZE_CLASSES; i++) {
+    __nxsan_drain_cache(*this, i, counts[i]);
+  }
+}
+
+// Fetches this thread's cache, discarding it if stale.
+static inline __attribute__((always_inline)) __nxsan_thread_cache &
+__nxsan_get_thread_cache() {
+  uint64_t generation = __nxsan_alloc_generation.load(std::memory_order_relaxed);
+  if (__builtin_expect(__nxsan_tcache.generation != generation, 0)) {
+    std::memset(__nxsan_tcache.lists, 0, sizeof(__nxsan_tcache.lists));
+    std::memset(__nxsan_tcache.counts, 0, sizeof(__nxsan_tcache.counts));
+    __nxsan_tcache.generation = generation;
+  }
+  return __nxsan_tcache;
+}
+
+bool __nxsan_region_init() {
+  std::lock_guard<std::mutex> guard(__nxsan_region_lock);
+
+  // Spans are aligned to the span size, and never overlap the null page.
+  uint64_t base = (uint64_t)__nxsan_heap_base;
+  uint64_t tail = (uint64_t)__nxsan_get_heap_tail();
+  uint64_t spanBase = (base + __NXSAN_SPAN_SIZE_BYTES - 1) /
+                      __NXSAN_SPAN_SIZE_BYTES * __NXSAN_SPAN_SIZE_BYTES;
+  __nxsan_span_base = (uint8_t *)spanBase;
+  __nxsan_span_table_size =
+      tail > spanBase ? (tail - spanBase) / __NXSAN_SPAN_SIZE_BYTES : 0;
+  __nxsan_region_cursor = (uint8_t *)std::max<uint64_t>(
+      spanBase, __NXSAN_PAGE_SIZE_BYTES > __NXSAN_SPAN_SIZE_BYTES
+                    ? __NXSAN_PAGE_SIZE_BYTES
+                    : __NXSAN_SPAN_SIZE_BYTES);
+  __nxsan_alloc_generation.fetch_add(1, std::memory_order_relaxed);
+
+  // Heaps smaller than a span can be tracked, but never allocated from.
+  if (__nxsan_span_table_size == 0) {
+    return true;
+  }
+
+  // The span table is only committed where spans are reserved.
+  void *table = mmap(nullptr, __nxsan_span_table_size * sizeof(__nxsan_span *),
+                     PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (table == MAP_FAILED) {
+    __nxsan_span_table_size = 0;
+    return false;
+  }
+  __nxsan_span_table = (__nxsan_span **)table;
+  return true;
+}
+
+void __nxsan_region_terminate() {
+  std::lock_guard<std::mutex> guard(__nxsan_region_lock);
+  for (__nxsan_span *span : __nxsan_spans) {
+    munmap(span->base, span->size);
+    delete[] span->meta;
+    delete span;
+  }
+  __nxsan_spans.clear();
+  __nxsan_reserved_bytes = 0;
+  __nxsan_free_large.clear();
+  for (size_t i = 0; i < __NXSAN_NUM_SIZE_CLASSES; i++) {
+    std::lock_guard<std::mutex> centralGuard(__nxsan_central[i].lock);
+    __nxsan_central[i].head = nullptr;
+  }
+  if (__nxsan_span_table) {
+    munmap(__nxsan_span_table, __nxsan_span_table_size * sizeof(__nxsan_span *));
+  }
+  __nxsan_span_table = nullptr;
+  __nxsan_span_table_size = 0;
+  __nxsan_span_base = nullptr;
+  __nxsan_region_cursor = nullptr;
+  __nxsan_alloc_generation.fetch_add(1, std::memory_order_relaxed);
+}
+
+void *__nxsan_region_alloc(size_t size, __nxsan_chunk_meta **meta) {
+  if (size > __NXSAN_MAX_SMALL_SIZE) {
+    return __nxsan_alloc_large(size, meta);
+  }
+
+  size_t sizeClass = __nxsan_size_class(size);
+  __nxsan_thread_cache &cache = __nxsan_get_thread_cache();
+  if (!cache.lists[sizeClass] && !__nxsan_refill_cache(cache, sizeClass)) {
+    return nullptr;
+  }
+
+  __nxsan_free_chunk *chunk = cache.lists[sizeClass];
+  cache.lists[sizeClass] = chunk->next;
+  cache.counts[sizeClass]--;
+
+  __nxsan_span *span = __nxsan_region_lookup(chunk);
+  *meta = &span->meta[((uint8_t *)chunk - span->base) / span->chunkSize];
+  return chunk;
+}
+
+__nxsan_chunk_meta *__nxsan_region_get_meta(void *ptr) {
+  __nxsan_span *span = __nxsan_region_lookup(ptr);
+  if (!span) {
+    return nullptr;
+  }
+  size_t offset = (uint8_t *)ptr - span->base;
+  if (span->sizeClass == __NXSAN_LARGE_CLASS) {
+    return offset == 0 ? span->meta : nullptr;
+  }
+  if (offset % span->chunkSize != 0 ||
+      offset / span->chunkSize >= span->size / span->chunkSize) {
+    return nullptr;
+  }
+  return &span->meta[offset / span->chunkSize];
+}
+
+__nxsan_chunk_meta *__nxsan_region_find_chunk(void *ptr, void **chunk) {
+  __nxsan_span *span = __nxsan_region_lookup(ptr);
+  if (!span) {
+    return nullptr;
+  }
+  size_t idx = span->sizeClass == __NXSAN_LARGE_CLASS
+                   ? 0
+                   : ((uint8_t *)ptr - span->base) / span->chunkSize;
+  if (span->sizeClass != __NXSAN_LARGE_CLASS &&
+      idx >= span->size / span->chunkSize) {
+    return nullptr;
+  }
+  *chunk = span->base + idx * span->chunkSize;
+  return &span->meta[idx];
+}
+
+void __nxsan_region_free(void *ptr) {
+  __nxsan_span *span = __nxsan_region_lookup(ptr);
+
+  // Large runs are kept for reuse, but their pages are released.
+  if (span->sizeClass == __NXSAN_LARGE_CLASS) {
+    madvise(span->base, span->size, MADV_DONTNEED);
+    std::lock_guard<std::mutex> guard(__nxsan_region_lock);
+    __nxsan_free_large.insert({span->size, span});
+    return;
+  }
+
+  __nxsan_thread_cache &cache = __nxsan_get_thread_cache();
+  auto *chunk = (__nxsan_free_chunk *)ptr;
+  chunk->next = cache.lists[span->sizeClass];
+  cache.lists[span->sizeClass] = chunk;
+  if (++cache.counts[span->sizeClass] > __NXSAN_CACHE_BATCH * 2) {
+    __nxsan_drain_cache(cache, span->sizeClass, __NXSAN_CACHE_BATCH);
+  }
+}
+
+size_t __nxsan_region_get_reserved_bytes() {
+  std::lock_guard<std::mutex> guard(__nxsan_region_lock);
+  return __nxsan_reserved_bytes;
+}
+
+void __nxsan_region_for_each_live(void (*fn)(void *ptr,
+                                             const __nxsan_chunk_meta *meta,
+                                             void *ctx),
+                                  void *ctx) {
+  std::lock_guard<std::mutex> guard(__nxsan_region_lock);
+  for (__nxsan_span *span : __nxsan_spans) {
+    size_t numChunks = span->sizeClass == __NXSAN_LARGE_CLASS
+                           ? 1
+                           : span->size / span->chunkSize;
+    for (size_t i = 0; i < numChunks; i++) {
+      if (span->meta[i].state == __NXSAN_CHUNK_LIVE) {
+        fn(span->base + i * span->chunkSize, &span->meta[i], ctx);
+      }
+    }
+  }
+}
@@ -1,49 +1,132 @@
 #include "runtime/nxsan_internal.h"
 
-// Defines for backtracing.
-#define __NXSAN_BT_MAX_DEPTH 64
+// Defines for backtracing. Depths set through flags are capped to these.
+#define __NXSAN_BT_MAX_DEPTH 256
+#define __NXSAN_BT_MAX_CAPTURE_DEPTH 64
 #define __NXSAN_BT_UNAVAILABLE_MSG "\nNOTE: NxSanitizer cannot provide additional information.\n"
-#define __NXSAN_BT_UNK_SYMBOL_MSG "(missing symbol)"
 
 // Cross-platform includes.
-#include <cstdlib>
+#include <algorithm>
 #include <string>
 
 // Platform-specific includes.
 #ifdef linux
 #include <execinfo.h>
+#include <pthread.h>
 #endif
 
+// Formats the given PCs as a symbolized backtrace. Symbols are resolved (and
+// cached) only here, when a report is printed.
+static std::string __nxsan_format_pcs(void* const* pcs, int numPcs) {
+  std::string btMsg;
+  for (int i = 0; i < numPcs; i++) {
+    btMsg += "   #" + std::to_string(i) + " " + __nxsan_symbolize_pc(pcs[i]) + "\n";
+  }
+  return btMsg;
+}
+
 std::string __nxsan_bt() {
 #ifdef linux
   void* btCallersBuf[__NXSAN_BT_MAX_DEPTH];
 
   // Get backtrace with hard limit.
-  int numCallers = backtrace(btCallersBuf, __NXSAN_BT_MAX_DEPTH);
+  int depth = (int)std::min<uint64_t>(__nxsan_flags.btDepth, __NXSAN_BT_MAX_DEPTH);
+  int numCallers = backtrace(btCallersBuf, depth);
   if (numCallers == 0) {
     return __NXSAN_BT_UNAVAILABLE_MSG;
   }
+  return __nxsan_format_pcs(btCallersBuf, numCallers);
+#else
+  return __NXSAN_BT_UNAVAILABLE_MSG;
+#endif
+}
 
-  // Get backtrace symbols.
-  char** btSymbols = backtrace_symbols(btCallersBuf, numCallers);
+#ifdef linux
+// Bounds of the current thread's stack, fetched on first capture. A frame
+// pointer walk ends at the first frame outside of them.
+static thread_local uintptr_t __nxsan_stack_lo = 0;
+static thread_local uintptr_t __nxsan_stack_hi = 0;
 
-  // For each caller, output to the message buffer.
-  std::string btMsg;
-  for (int i = 0; i < numCallers; i++) {
-    // Fetch symbol for backtrace.
-    const char* symbol = btSymbols[i];
-    if (!symbol) {
-      symbol = "(missing symbol)";
-    }
+// Set while fetching the stack bounds, as that may allocate through an
+// interposed malloc & so capture a stack itself.
+static thread_local bool __nxsan_stack_fetching = false;
 
-    btMsg += "   #" + std::to_string(i) + " " + std::string(symbol) + "\n";
+// Fetches the bounds of the current thread's stack if not yet known, returning
+// whether they are available.
+static inline __attribute__((always_inline)) bool __nxsan_get_stack_bounds() {
+  if (__builtin_expect(__nxsan_stack_hi != 0, 1)) {
+    return true;
+  }
+  if (__nxsan_stack_fetching) {
+    return false;
   }
+  __nxsan_stack_fetching = true;
+  pthread_attr_t attr;
+  if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+    void* addr;
+    size_t size;
+    if (pthread_attr_getstack(&attr, &addr, &size) == 0) {
+      __nxsan_stack_lo = (uintptr_t)addr;
+      __nxsan_stack_hi = (uintptr_t)addr + size;
+    }
+    pthread_attr_destroy(&attr);
+  }
+  __nxsan_stack_fetching = false;
+  return __nxsan_stack_hi != 0;
+}
 
-  // Free symbols buffer.
-  std::free((void*)btSymbols);
+// Walks the frame pointer chain from the caller of the enclosing function,
+// recording up to the given number of return addresses. Much cheaper than
+// backtrace(), which unwinds through DWARF, but stops early at the first
+// frame built without a frame pointer.
+static inline __attribute__((always_inline)) int __nxsan_fast_unwind(void** pcs, int maxDepth) {
+  uintptr_t* frame = (uintptr_t*)__builtin_frame_address(0);
+  int numPcs = 0;
+  while (numPcs < maxDepth) {
+    // Each frame holds the previous frame pointer, then the return address.
+    uintptr_t fp = (uintptr_t)frame;
+    if (fp < __nxsan_stack_lo || fp + 2 * sizeof(uintptr_t) > __nxsan_stack_hi || fp % sizeof(uintptr_t) != 0) {
+      break;
+    }
+    uintptr_t pc = frame[1];
+    if (pc < 4096) {
+      break;
+    }
+    pcs[numPcs++] = (void*)pc;
 
-  return btMsg;
+    // The stack grows down, so callers' frames are at higher addresses.
+    uintptr_t* next = (uintptr_t*)frame[0];
+    if (next <= frame) {
+      break;
+    }
+    frame = next;
+  }
+  return numPcs;
+}
+#endif
+
+uint32_t __nxsan_capture_stack() {
+#ifdef linux
+  uint64_t depth = std::min<uint64_t>(__nxsan_flags.allocBtDepth, __NXSAN_BT_MAX_CAPTURE_DEPTH);
+  if (depth == 0 || !__nxsan_get_stack_bounds()) {
+    return 0;
+  }
+  void* btCallersBuf[__NXSAN_BT_MAX_CAPTURE_DEPTH];
+  int numCallers = __nxsan_fast_unwind(btCallersBuf, (int)depth);
+  if (numCallers == 0) {
+    return 0;
+  }
+  return __nxsan_depot_put(btCallersBuf, numCallers);
 #else
-  return __NXSAN_BT_UNAVAILABLE_MSG;
+  return 0;
 #endif
 }
+
+std::string __nxsan_format_stack(uint32_t id) {
+  void* const* pcs;
+  size_t numPcs = __nxsan_depot_get(id, &pcs);
+  if (numPcs == 0) {
+    return __NXSAN_BT_UNAVAILABLE_MSG;
+  }
+  return __nxsan_format_pcs(pcs, (int)numPcs);
+}
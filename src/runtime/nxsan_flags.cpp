@@ -0,0 +1,141 @@
+#include "runtime/nxsan_internal.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdio.h>
+
+// Environment variable holding runtime options, as a list of name=value pairs
+// separated by colons, commas or whitespace.
+#define __NXSAN_OPTIONS_ENV "NXSAN_OPTIONS"
+
+// Maximum length of NXSAN_OPTIONS. String-valued flags point into a copy.
+#define __NXSAN_OPTIONS_MAX_LEN 4096
+
+// Compile-time defaults for each flag.
+#ifndef __NXSAN_QUARANTINE_SIZE_BYTES
+#define __NXSAN_QUARANTINE_SIZE_BYTES (64 * 1024 * 1024)
+#endif
+#ifndef __NXSAN_BT_CAPTURE_DEPTH
+#define __NXSAN_BT_CAPTURE_DEPTH 16
+#endif
+#ifndef __NXSAN_BT_DEPTH
+#define __NXSAN_BT_DEPTH 64
+#endif
+#ifndef __NXSAN_SAMPLE_RATE
+#define __NXSAN_SAMPLE_RATE 1
+#endif
+
+// Default flag values, also used before the runtime is first initialised.
+static const __nxsan_flags_t __nxsan_default_flags = {
+    __NXSAN_QUARANTINE_SIZE_BYTES,
+    __NXSAN_BT_CAPTURE_DEPTH,
+    __NXSAN_BT_DEPTH,
+    __NXSAN_SAMPLE_RATE,
+    nullptr,
+    nullptr,
+    false,
+};
+
+__nxsan_flags_t __nxsan_flags = __nxsan_default_flags;
+
+// Copy of NXSAN_OPTIONS, which string-valued flags point into.
+static char __nxsan_options_buf[__NXSAN_OPTIONS_MAX_LEN];
+
+// Types of flag value.
+enum __nxsan_flag_type { __NXSAN_FLAG_BOOL, __NXSAN_FLAG_UINT, __NXSAN_FLAG_STR };
+
+// Description of a single flag. Integer values are multiplied by the scale.
+struct __nxsan_flag_desc {
+  const char* name;
+  __nxsan_flag_type type;
+  size_t offset;
+  uint64_t scale;
+};
+
+// clang-format off
+static const __nxsan_flag_desc __nxsan_flag_descs[] = {
+  {"quarantine_size_mb", __NXSAN_FLAG_UINT, offsetof(__nxsan_flags_t, quarantineSize), 1024 * 1024},
+  {"alloc_bt_depth",     __NXSAN_FLAG_UINT, offsetof(__nxsan_flags_t, allocBtDepth),   1},
+  {"bt_depth",           __NXSAN_FLAG_UINT, offsetof(__nxsan_flags_t, btDepth),        1},
+  {"sample_rate",        __NXSAN_FLAG_UINT, offsetof(__nxsan_flags_t, sampleRate),     1},
+  {"symbolizer_path",    __NXSAN_FLAG_STR,  offsetof(__nxsan_flags_t, symbolizerPath), 1},
+  {"stats_path",         __NXSAN_FLAG_STR,  offsetof(__nxsan_flags_t, statsPath),      1},
+  {"recover",            __NXSAN_FLAG_BOOL, offsetof(__nxsan_flags_t, recover),        1},
+};
+// clang-format on
+
+// Parses a single flag value into the flags struct. Returns false if invalid.
+static bool __nxsan_parse_flag(const __nxsan_flag_desc& desc, char* value) {
+  void* field = (uint8_t*)&__nxsan_flags + desc.offset;
+  switch (desc.type) {
+  case __NXSAN_FLAG_BOOL:
+    if (!strcmp(value, "1") || !strcmp(value, "true")) {
+      *(bool*)field = true;
+    } else if (!strcmp(value, "0") || !strcmp(value, "false")) {
+      *(bool*)field = false;
+    } else {
+      return false;
+    }
+    return true;
+
+  case __NXSAN_FLAG_UINT: {
+    if (!*value || strspn(value, "0123456789") != strlen(value)) {
+      return false;
+    }
+    uint64_t parsed = strtoull(value, nullptr, 10);
+    if (parsed > UINT64_MAX / desc.scale) {
+      return false;
+    }
+    *(uint64_t*)field = parsed * desc.scale;
+    return true;
+  }
+
+  case __NXSAN_FLAG_STR:
+    *(const char**)field = *value ? value : nullptr;
+    return true;
+  }
+  return false;
+}
+
+void __nxsan_init_flags() {
+  __nxsan_flags = __nxsan_default_flags;
+  const char* options = getenv(__NXSAN_OPTIONS_ENV);
+  if (!options) {
+    return;
+  }
+  if (strlen(options) >= sizeof(__nxsan_options_buf)) {
+    fprintf(stderr, "WARNING: NxSanitizer: %s is too long, ignoring it.\n", __NXSAN_OPTIONS_ENV);
+    return;
+  }
+  strcpy(__nxsan_options_buf, options);
+
+  char* save = nullptr;
+  for (char* option = strtok_r(__nxsan_options_buf, ":, \t\n", &save); option;
+       option = strtok_r(nullptr, ":, \t\n", &save)) {
+    char* value = strchr(option, '=');
+    if (!value) {
+      fprintf(stderr, "WARNING: NxSanitizer: expected name=value in %s, got '%s'.\n", __NXSAN_OPTIONS_ENV, option);
+      continue;
+    }
+    *value++ = '\0';
+
+    bool known = false;
+    for (const __nxsan_flag_desc& desc : __nxsan_flag_descs) {
+      if (strcmp(option, desc.name)) {
+        continue;
+      }
+      known = true;
+      if (!__nxsan_parse_flag(desc, value)) {
+        fprintf(stderr, "WARNING: NxSanitizer: invalid value '%s' for flag '%s'.\n", value, option);
+      }
+      break;
+    }
+    if (!known) {
+      fprintf(stderr, "WARNING: NxSanitizer: unknown flag '%s' in %s.\n", option, __NXSAN_OPTIONS_ENV);
+    }
+  }
+
+  // A sample rate of zero would never check anything, treat it as one.
+  __nxsan_flags.sampleRate = std::max<uint64_t>(__nxsan_flags.sampleRate, 1);
+}
@@ -1,18 +1,174 @@
 #include "runtime/nxsan_internal.h"
 #include "runtime/nxsan_runtime.h"
 
+#include <algorithm>
 #include <cstdlib>
+#include <cstring>
+#include <stdio.h>
+#include <string>
+#include <sys/mman.h>
+#include <unordered_map>
+#include <vector>
+
+// Whether to hint that shadow memory should be backed by transparent huge
+// pages. Reduces TLB pressure for dense heaps, at the cost of committing
+// memory in larger chunks.
+#ifndef __NXSAN_SHADOW_USE_THP
+#define __NXSAN_SHADOW_USE_THP 0
+#endif
+
+// Maximum number of allocation sites listed in a leak report.
+#ifndef __NXSAN_LEAK_MAX_SITES
+#define __NXSAN_LEAK_MAX_SITES 32
+#endif
+
+// Whether to keep the shadow reservation on termination for reuse by a later
+// initialisation, discarding its pages rather than unmapping it.
+#ifndef __NXSAN_SHADOW_RETAIN
+#define __NXSAN_SHADOW_RETAIN 0
+#endif
 
 // nxsan shadow memory store, size
 uint8_t* __nxsan_shadow = nullptr;
 size_t __nxsan_shadow_size = 0;
 
+// Reserved shadow mapping, which may outlive a single init/terminate cycle.
+static void* __nxsan_shadow_mapping = nullptr;
+static size_t __nxsan_shadow_mapping_size = 0;
+
 // nsan heap base
 uint8_t* __nxsan_heap_base = nullptr;
 
+// Reserves an anonymous, zeroed shadow mapping of at least the given size.
+// Reuses a retained mapping if it is large enough.
+static bool __nxsan_reserve_shadow(size_t size) {
+  if (__nxsan_shadow_mapping && __nxsan_shadow_mapping_size >= size) {
+    return true;
+  }
+  if (__nxsan_shadow_mapping) {
+    munmap(__nxsan_shadow_mapping, __nxsan_shadow_mapping_size);
+    __nxsan_shadow_mapping = nullptr;
+    __nxsan_shadow_mapping_size = 0;
+  }
+
+  void* mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (mapping == MAP_FAILED) {
+    return false;
+  }
+#if __NXSAN_SHADOW_USE_THP && defined(MADV_HUGEPAGE)
+  madvise(mapping, size, MADV_HUGEPAGE);
+#endif
+
+  __nxsan_shadow_mapping = mapping;
+  __nxsan_shadow_mapping_size = size;
+  return true;
+}
+
+// Releases the shadow mapping. When retained, committed pages are discarded so
+// the mapping reads as zero on reuse.
+static void __nxsan_release_shadow() {
+#if __NXSAN_SHADOW_RETAIN
+  madvise(__nxsan_shadow_mapping, __nxsan_shadow_mapping_size, MADV_DONTNEED);
+#else
+  munmap(__nxsan_shadow_mapping, __nxsan_shadow_mapping_size);
+  __nxsan_shadow_mapping = nullptr;
+  __nxsan_shadow_mapping_size = 0;
+#endif
+}
+
+// Leaked allocations from a single allocation site.
+struct __nxsan_leak_site {
+  uint32_t stack;
+  size_t count;
+  size_t bytes;
+};
+
+// Accumulates a live chunk into the leak report.
+static void __nxsan_collect_leak(void* /*ptr*/, const __nxsan_chunk_meta* meta, void* ctx) {
+  auto& sites = *(std::unordered_map<uint32_t, __nxsan_leak_site>*)ctx;
+  __nxsan_leak_site& site = sites[meta->allocStack];
+  site.stack = meta->allocStack;
+  site.count++;
+  site.bytes += meta->size;
+}
+
+// Totals of live chunks, for runtime statistics.
+struct __nxsan_live_totals {
+  size_t count;
+  size_t bytes;
+};
+
+// Accumulates a live chunk into the live totals.
+static void __nxsan_count_live(void* /*ptr*/, const __nxsan_chunk_meta* meta, void* ctx) {
+  auto& totals = *(__nxsan_live_totals*)ctx;
+  totals.count++;
+  totals.bytes += meta->size;
+}
+
+// Writes runtime statistics to the configured stats path, if any.
+static void __nxsan_write_stats() {
+  const char* path = __nxsan_flags.statsPath;
+  if (!path) { return; }
+  bool toStderr = !strcmp(path, "-");
+  FILE* out = toStderr ? stderr : fopen(path, "w");
+  if (!out) {
+    fprintf(stderr, "WARNING: NxSanitizer: failed to open stats file '%s'.\n", path);
+    return;
+  }
+
+  __nxsan_live_totals live = {0, 0};
+  __nxsan_region_for_each_live(__nxsan_count_live, &live);
+  fprintf(out, "NxSanitizer stats:\n");
+  fprintf(out, "  heap reserved bytes:  %zu\n", __nxsan_region_get_reserved_bytes());
+  fprintf(out, "  live allocations:     %zu\n", live.count);
+  fprintf(out, "  live bytes:           %zu\n", live.bytes);
+  fprintf(out, "  quarantined bytes:    %zu\n", __nxsan_quarantine_get_bytes());
+  fprintf(out, "  stack depot bytes:    %zu\n", __nxsan_depot_get_used_bytes());
+  fprintf(out, "  reported errors:      %lu\n", __nxsan_get_num_reports());
+  if (!toStderr) { fclose(out); }
+}
+
+// Reports all outstanding allocations grouped by allocation site, largest
+// first, aborting if there are any unless in recover mode.
+static void __nxsan_check_leaks() {
+  std::unordered_map<uint32_t, __nxsan_leak_site> sites;
+  __nxsan_region_for_each_live(__nxsan_collect_leak, &sites);
+  if (sites.empty()) { return; }
+
+  std::vector<__nxsan_leak_site> sorted;
+  size_t totalCount = 0, totalBytes = 0;
+  for (auto& [stack, site] : sites) {
+    sorted.push_back(site);
+    totalCount += site.count;
+    totalBytes += site.bytes;
+  }
+  std::sort(sorted.begin(), sorted.end(), [](const __nxsan_leak_site& a, const __nxsan_leak_site& b) {
+    return a.bytes != b.bytes ? a.bytes > b.bytes : a.count > b.count;
+  });
+
+  std::string report;
+  char line[128];
+  for (size_t i = 0; i < sorted.size() && i < __NXSAN_LEAK_MAX_SITES; i++) {
+    snprintf(line, sizeof(line), "\n\n%zu byte(s) in %zu allocation(s) allocated at:\n", sorted[i].bytes,
+             sorted[i].count);
+    report += line;
+    report += __nxsan_format_stack(sorted[i].stack);
+  }
+  if (sorted.size() > __NXSAN_LEAK_MAX_SITES) {
+    snprintf(line, sizeof(line), "\n... and %zu more allocation site(s)", sorted.size() - __NXSAN_LEAK_MAX_SITES);
+    report += line;
+  }
+  __nxsan_report_err("Detected %zu byte(s) leaked in %zu allocation(s) (nxsan-leak):%s", totalBytes, totalCount,
+                     report.c_str());
+}
+
 extern "C" bool __nxsan_init(void* hBase, size_t hSize) {
   if (__nxsan_check_init()) { return false; }
 
+  // Parse runtime options before anything consults them.
+  __nxsan_init_flags();
+
   // Do not permit size zero.
   if (hSize < 1) {
     __nxsan_abort_with_err("Tracked heap size cannot be zero.");
@@ -25,30 +181,54 @@ extern "C" bool __nxsan_init(void* hBase, size_t hSize) {
     return false;
   }
 
+  // Reserve the shadow region. Pages are only committed (and zeroed) by the
+  // kernel on first touch, so untouched parts of the heap cost nothing.
+  size_t shadowSize = hSize / __NXSAN_TAG_GRANULARITY_BYTES;
+  if (!__nxsan_reserve_shadow(shadowSize)) {
+    __nxsan_abort_with_err("Failed to allocate nxsan shadow memory of size %zu.", shadowSize);
+    return false;
+  }
+
   // Configure heap base & shadow region.
-  __nxsan_shadow_size = hSize / __NXSAN_TAG_GRANULARITY_BYTES;
-  __nxsan_shadow = (uint8_t*)__NXSAN_INTERNAL_CALLOC(1, __nxsan_shadow_size);
+  __nxsan_shadow = (uint8_t*)__nxsan_shadow_mapping;
+  __nxsan_shadow_size = shadowSize;
   __nxsan_heap_base = (uint8_t*)hBase;
 
-  // Report an error if allocation fails.
-  if (!__nxsan_shadow) {
-    __nxsan_abort_with_err("Failed to allocate nxsan shadow memory of size %zu.", __nxsan_shadow_size);
+  // Initialise the allocator over the tracked heap.
+  if (!__nxsan_region_init()) {
+    __nxsan_abort_with_err("Failed to initialise the nxsan heap allocator.");
     return false;
   }
 
-  // Initialise the tag generator.
+  // Initialise the tag generator & shadow kernels.
   __nxsan_init_tag_gen();
+  __nxsan_init_shadow_kernels();
   return true;
 }
 
+extern "C" void __nxsan_set_recover(bool recover) { __nxsan_flags.recover = recover; }
+
+extern "C" void __nxsan_set_sample_rate(size_t rate) {
+  __nxsan_flags.sampleRate = std::max<size_t>(rate, 1);
+  __nxsan_sample_countdown = 0;
+}
+
 extern "C" bool __nxsan_terminate() {
   if (!__nxsan_check_init()) { return false; }
 
+  // Write statistics before leak checking, which may abort.
+  __nxsan_write_stats();
+
   // Verify that all allocations have been de-allocated.
-  // ...
+  __nxsan_check_leaks();
+
+  // Release all tracked heap memory, including anything in quarantine.
+  __nxsan_quarantine_terminate();
+  __nxsan_region_terminate();
 
-  // Free shadow region.
-  __NXSAN_INTERNAL_FREE(__nxsan_shadow);
+  // Release shadow region.
+  __nxsan_release_shadow();
+  __nxsan_shadow = nullptr;
   __nxsan_shadow_size = 0;
   __nxsan_heap_base = nullptr;
   return true;
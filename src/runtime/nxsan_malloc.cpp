@@ -2,25 +2,47 @@
 #include "runtime/nxsan_runtime.h"
 
 #include <algorithm>
+#include <atomic>
 #include <cstdint>
-#include <cstdlib>
-
-// Allocation byte size threshold for avoiding tag values of <TG.
-// When tag values are <TG, detection of use-after-free becomes very difficult
-// when application code accesses past the first granule of the freed
-// allocation. We can somewhat mitigate the effects of this by avoiding small
-// tag values for large allocations.
-#define __NXSAN_AVOID_SMALL_TAG_THRESH 256
+#include <random>
 
 // Tag generator logic.
-static std::random_device __nxsan_rd;
-static std::mt19937 __nxsan_mt_gen;
-std::uniform_int_distribution<short> __nxsan_tag_dist;
+// Each thread runs its own xorshift64* generator, so tag generation involves no
+// shared state beyond seeding. Seeds are derived from a random process-wide
+// seed mixed with a unique per-thread index.
+static std::atomic<uint64_t> __nxsan_tag_seed{0};
+static std::atomic<uint64_t> __nxsan_tag_thread_idx{0};
+static thread_local uint64_t __nxsan_tag_state = 0;
 
 void __nxsan_init_tag_gen() {
-  __nxsan_mt_gen = std::mt19937(__nxsan_rd());
-  __nxsan_tag_dist =
-      std::uniform_int_distribution<short>(1, __NXSAN_TAG_MAX_VAL);
+  std::random_device rd;
+  __nxsan_tag_seed.store(((uint64_t)rd() << 32) | rd(),
+                         std::memory_order_relaxed);
+}
+
+// Mixes the given value into a well-distributed 64-bit seed (splitmix64).
+static inline __attribute__((always_inline)) uint64_t
+__nxsan_mix_seed(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ull;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+}
+
+// Fetches the next random value from this thread's generator.
+static inline __attribute__((always_inline)) uint64_t __nxsan_next_rand() {
+  uint64_t x = __nxsan_tag_state;
+  if (__builtin_expect(x == 0, 0)) {
+    uint64_t idx = __nxsan_tag_thread_idx.fetch_add(1, std::memory_order_relaxed);
+    x = __nxsan_mix_seed(__nxsan_tag_seed.load(std::memory_order_relaxed) ^
+                         __nxsan_mix_seed(idx));
+    x = x ? x : 1;
+  }
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  __nxsan_tag_state = x;
+  return x * 0x2545F4914F6CDD1Dull;
 }
 
 // Generates an N-bit pointer tag for the given allocation.
@@ -29,32 +51,29 @@ void __nxsan_init_tag_gen() {
 // Guaranteed to generate a tag which is different to the preceeding and
 // proceeding shadow memory regions.
 static inline __attribute__((always_inline)) uint8_t
-__nxsan_generate_tag(void *ptr, size_t size) {
+__nxsan_generate_tag(void *ptr, size_t allocated) {
   // Fetch the shadow tag preceding this alloc.
+  // Neighbouring tags are owned by other allocations, and so may change
+  // concurrently. They are only a hint for avoiding adjacent identical tags.
   uint8_t *prevShadowPtr = __nxsan_get_shadow_address(ptr) - 1;
   uint8_t prevShadowTag = 0;
   if (prevShadowPtr >= __nxsan_shadow) {
-    prevShadowTag = *prevShadowPtr;
+    prevShadowTag = __nxsan_load_shadow(prevShadowPtr);
   }
 
   // Fetch the shadow tag following this alloc.
-  uint8_t *allocTail = (uint8_t *)ptr + size;
-  uint8_t *nextShadowPtr = __nxsan_get_shadow_address(allocTail) + 1;
+  uint8_t *nextShadowPtr = __nxsan_get_shadow_address(ptr) +
+                           allocated / __NXSAN_TAG_GRANULARITY_BYTES;
   uint8_t nextShadowTag = 0;
   if (nextShadowPtr < __nxsan_shadow + __nxsan_shadow_size) {
-    nextShadowTag = *nextShadowPtr;
+    nextShadowTag = __nxsan_load_shadow(nextShadowPtr);
   }
 
-  // Determine whether we must avoid small tag values for this alloc.
-  bool avoidSmallTag = size >= __NXSAN_AVOID_SMALL_TAG_THRESH;
-
   // Generate tag, ensuring it is not the same as the prior/next tag.
-  // If the tag is <TG and we must avoid small tags, also re-generate.
   uint8_t tag;
   do {
-    tag = ((uint8_t)__nxsan_tag_dist(__nxsan_mt_gen));
-  } while (tag == prevShadowTag || tag == nextShadowTag ||
-           (avoidSmallTag && tag < __NXSAN_TAG_GRANULARITY_BYTES));
+    tag = (uint8_t)(__nxsan_next_rand() >> (64 - __NXSAN_TAG_SIZE_BITS));
+  } while (tag == 0 || tag == prevShadowTag || tag == nextShadowTag);
 
   return tag;
 }
@@ -69,9 +88,7 @@ __nxsan_set_shadow_tag(void *ptr, size_t size, size_t allocated) {
   // Set *up to* the final shadow byte to the tag.
   size_t shadowSize = std::max(allocated / __NXSAN_TAG_GRANULARITY_BYTES, 1ul);
   uint8_t tag = __NXSAN_EXTRACT_TAG(ptr);
-  for (int i = 0; i < shadowSize - 1; ++i) {
-    *(shadowAddr + i) = tag;
-  }
+  __nxsan_shadow_fill(shadowAddr, tag, shadowSize - 1);
 
   // If the allocation is not a multiple of the tag granularity, then we need to
   // use a short granule to track the partial allocation in the final shadow
@@ -81,57 +98,26 @@ __nxsan_set_shadow_tag(void *ptr, size_t size, size_t allocated) {
   if (size % __NXSAN_TAG_GRANULARITY_BYTES > 0) {
     // Set short granule.
     uint8_t lastShadowVal = (uint8_t)(size % __NXSAN_TAG_GRANULARITY_BYTES);
-    *lastShadowAddr = lastShadowVal;
+    __nxsan_store_shadow(lastShadowAddr, lastShadowVal);
 
-    // Store tag in final byte of real allocation granule.
-    uint8_t *finalByte = (uint8_t *)ptr + (allocated - 1);
+    // Store tag in final byte of real allocation granule. This is written
+    // through the untagged address, as the tag is not yet valid for it.
+    uint8_t *finalByte = (uint8_t *)__NXSAN_REMOVE_TAG(ptr) + (allocated - 1);
     *finalByte = tag;
   } else {
     // Allocation is perfectly aligned with tag granularity.
     // Set final tag byte directly to the tag.
-    *lastShadowAddr = tag;
+    __nxsan_store_shadow(lastShadowAddr, tag);
   }
 }
 
-// Clears the shadow tag in memory for the given pointer.
-// Since we don't know the size of the allocation at the point of free, we must
-// make some concessions on how accurate we can be about clearing tagged shadow
-// memory.
-//  * We cannot clear trailing short granules in >1 granule allocations, as this
-//    is just as likely to be the next tag in allocated memory.
-//  * We cannot clear past the first granule if the tag value is <TG, as it is
-//    possible the next value is a short granule which equals the current tag.
-//  * We *can* clear up until the tag value changes if the tag is >=TG, as
-//    consecutive tags are guaranteed to differ meaning two identical tags will
-//    never line up in shadow memory.
-// To combat the above limitations, for larger allocations we deliberately avoid
-// tag values between 1 and TG-1 (threshold configurable above).
+// Clears the shadow tags for the given allocation, including any trailing
+// short granule.
 static inline __attribute__((always_inline)) void
-__nxsan_clear_shadow_tag(void *ptr, uint8_t tag) {
-  // Clear the tag value of the first granule.
+__nxsan_clear_shadow_tag(void *ptr, size_t allocated) {
   uint8_t *shadowAddr = __nxsan_get_shadow_address(ptr);
-  uint8_t origTag = *shadowAddr;
-  *shadowAddr = 0x0;
-
-  // If the original tag was a short tag, the allocation was <TG bytes.
-  // Thus, we have cleared all of the relevant shadow bytes.
-  if (origTag != tag) {
-    return;
-  }
-
-  // If the tag is <TG, we cannot do anything more (see above).
-  if (tag < __NXSAN_TAG_GRANULARITY_BYTES) {
-    return;
-  }
-
-  // Clear up until the tag value differs. We also can't clear our own final
-  // short granule, so don't bother checking for that.
-  ++shadowAddr;
-  while (shadowAddr < __nxsan_shadow + __nxsan_shadow_size &&
-         *shadowAddr == tag) {
-    *shadowAddr = 0x0;
-    ++shadowAddr;
-  }
+  __nxsan_shadow_fill(shadowAddr, 0x0,
+                      allocated / __NXSAN_TAG_GRANULARITY_BYTES);
 }
 
 extern "C" void *__nxsan_malloc(size_t size) {
@@ -148,16 +134,18 @@ extern "C" void *__nxsan_malloc(size_t size) {
     return nullptr;
   }
 
-  // Allocate memory of the given size.
+  // Allocate memory of the given size from the tracked heap.
   // The memory location and size must both be aligned to the tag granularity
   // to:
   // - Ensure no collision of allocations in shadow memory.
   // - Ensure the short granule can always be stored in the last byte of an
   // allocated granule.
-  size_t alignedSize = size + __NXSAN_TAG_GRANULARITY_BYTES -
-                       (size % __NXSAN_TAG_GRANULARITY_BYTES);
-  void *ptr = __NXSAN_INTERNAL_ALIGNED_ALLOC(__NXSAN_TAG_GRANULARITY_BYTES,
-                                             alignedSize);
+  size_t alignedSize = (size + __NXSAN_TAG_GRANULARITY_BYTES - 1) /
+                       __NXSAN_TAG_GRANULARITY_BYTES *
+                       __NXSAN_TAG_GRANULARITY_BYTES;
+  __nxsan_chunk_meta *meta = nullptr;
+  void *ptr =
+      alignedSize >= size ? __nxsan_region_alloc(alignedSize, &meta) : nullptr;
   if (!ptr) {
     // Failed to allocate memory.
     __nxsan_abort_with_err("Failed to allocate memory of size %zu (real "
@@ -166,58 +154,54 @@ extern "C" void *__nxsan_malloc(size_t size) {
     return nullptr;
   }
 
-  // If the returned allocation falls outside of tracked memory, we can't tag
-  // it.
-  if (!__nxsan_alloc_in_heap_bounds(ptr, size)) {
-    __nxsan_abort_with_err(
-        "Allocation fell outside of tracked heap bounds: [%p, %p) outside of "
-        "range [%p, %p) (nxsan-alloc-oob).",
-        ptr, (uint8_t *)ptr + size, __nxsan_shadow,
-        __nxsan_shadow + __nxsan_shadow_size);
-    return nullptr;
-  }
-
   // Generate a random tag for the pointer, update shadow memory.
-  uint8_t tag = __nxsan_generate_tag(ptr, size);
+  uint8_t tag = __nxsan_generate_tag(ptr, alignedSize);
   ptr = __NXSAN_EMPLACE_TAG(ptr, tag);
 
   // Update shadow memory for the given tag.
   __nxsan_set_shadow_tag(ptr, size, alignedSize);
 
+  // Record the allocation, so that free knows its exact extent.
+  meta->size = size;
+  meta->tag = tag;
+  meta->state = __NXSAN_CHUNK_LIVE;
+  meta->allocStack = __nxsan_capture_stack();
+  meta->freeStack = 0;
+
   return ptr;
 }
 
 extern "C" void __nxsan_free(void *ptr) {
   if (!__nxsan_check_init()) {
     // Not initialised, cannot malloc.
-    __nxsan_abort_with_access_err(ptr,
-                                  "nxsan is not initialised, but attempted to "
-                                  "free memory (nxsan-noinit-free).");
+    __NXSAN_REPORT_ACCESS_ERR(ptr,
+                              "nxsan is not initialised, but attempted to "
+                              "free memory (nxsan-noinit-free).");
     return;
   }
 
   // Is the given pointer within the heap bounds?
   void *ptrNoTag = __NXSAN_REMOVE_TAG(ptr);
   if (!__nxsan_ptr_in_heap_bounds(ptrNoTag)) {
-    __nxsan_abort_with_access_err(ptr,
-                                  "Attempted to free pointer outside of heap "
-                                  "bounds [%p, %p) (nxsan-oob-free).",
-                                  __nxsan_shadow,
-                                  __nxsan_shadow + __nxsan_shadow_size);
+    __NXSAN_REPORT_ACCESS_ERR(ptr,
+                              "Attempted to free pointer outside of heap "
+                              "bounds [%p, %p) (nxsan-oob-free).",
+                              __nxsan_shadow,
+                              __nxsan_shadow + __nxsan_shadow_size);
     return;
   }
 
   // If the pointer is unaligned, something has gone horribly wrong.
   // Someone is trying to free memory from halfway through the allocation...
   if ((uint64_t)ptrNoTag % __NXSAN_TAG_GRANULARITY_BYTES > 0) {
-    __nxsan_abort_with_access_err(
+    __NXSAN_REPORT_ACCESS_ERR(
         ptr, "Attempted to free unaligned pointer (nxsan-unaligned-free).");
     return;
   }
 
   // Stop someone trying to free the shadow memory (WTF?).
   if (ptrNoTag == __nxsan_shadow) {
-    __nxsan_abort_with_access_err(
+    __NXSAN_REPORT_ACCESS_ERR(
         ptr, "Attempted to free nxsan shadow memory (seriously?).",
         __nxsan_shadow);
     return;
@@ -229,23 +213,23 @@ extern "C" void __nxsan_free(void *ptr) {
   if (result != __NXSAN_PTR_OK) {
     switch (result) {
     case __NXSAN_PTR_NOTAG:
-      __nxsan_abort_with_access_err(
+      __NXSAN_REPORT_ACCESS_ERR(
           ptr, "Attempted to free memory with no tag (nxsan-notag-free).");
       return;
 
     case __NXSAN_PTR_BADTAG:
-      __nxsan_abort_with_access_err(
+      __NXSAN_REPORT_ACCESS_ERR(
           ptr, "Attempted to free memory with bad tag (nxsan-badtag-free).");
       return;
 
     case __NXSAN_PTR_FREED:
-      __nxsan_abort_with_access_err(
+      __NXSAN_REPORT_ACCESS_ERR(
           ptr, "Attempted to free unallocated memory (nxsan-double-free).");
       return;
 
     // Attempted to free from the null page.
     case __NXSAN_PTR_NULLPAGE:
-      __nxsan_abort_with_access_err(
+      __NXSAN_REPORT_ACCESS_ERR(
           ptr, "Attempted to free from the null page (nxsan-nullpage-free).");
       return;
 
@@ -253,21 +237,35 @@ extern "C" void __nxsan_free(void *ptr) {
     // unreachable.
     case __NXSAN_PTR_OUT_OF_HEAP:
     case __NXSAN_PTR_OVERRUN:
-      __nxsan_abort_with_access_err(
+      __NXSAN_REPORT_ACCESS_ERR(
           ptr, "Unreachable internal error (nxsan-unreachable-free).");
       return;
 
     default:
-      __nxsan_abort_with_access_err(
+      __NXSAN_REPORT_ACCESS_ERR(
           ptr, "Unimplemented tag error (nxsan-unimpl-tag).");
       return;
     }
   }
 
-  // Free the underlying heap memory.
-  __NXSAN_INTERNAL_FREE(ptrNoTag);
+  // The pointer must be the start of a live allocation, not part way through
+  // one whose tag happens to match.
+  __nxsan_chunk_meta *meta = __nxsan_region_get_meta(ptrNoTag);
+  if (!meta || meta->state != __NXSAN_CHUNK_LIVE || meta->tag != tag) {
+    __NXSAN_REPORT_ACCESS_ERR(
+        ptr, "Attempted to free pointer which is not the start of an "
+             "allocation (nxsan-invalid-free).");
+    return;
+  }
+
+  // Remove the tag in shadow memory (set to 0x0) for the whole allocation.
+  // This must happen before the memory is released, as another thread may
+  // re-allocate (and re-tag) it as soon as it is.
+  size_t alignedSize = __nxsan_meta_aligned_size(meta);
+  __nxsan_clear_shadow_tag(ptrNoTag, alignedSize);
+  meta->state = __NXSAN_CHUNK_QUARANTINED;
+  meta->freeStack = __nxsan_capture_stack();
 
-  // Remove the tag in shadow memory (set to 0x0).
-  // This isn't perfect, see function comment for details.
-  __nxsan_clear_shadow_tag(ptrNoTag, tag);
+  // Hold the memory in quarantine before it is reused.
+  __nxsan_quarantine_put(ptrNoTag, alignedSize);
 }
@@ -0,0 +1,144 @@
+#include "runtime/nxsan_internal.h"
+
+#include <atomic>
+#include <mutex>
+
+// Maximum number of chunks & bytes held in a thread's batch before it is
+// moved to the global quarantine. Each thread may hold up to one batch on top
+// of the global budget.
+#define __NXSAN_QUARANTINE_BATCH_CHUNKS 64
+#define __NXSAN_QUARANTINE_BATCH_BYTES (1024 * 1024)
+
+// A batch of quarantined chunks, freed by a single thread.
+struct __nxsan_quarantine_batch {
+  __nxsan_quarantine_batch *next = nullptr;
+  void *chunks[__NXSAN_QUARANTINE_BATCH_CHUNKS];
+  size_t count = 0;
+  size_t bytes = 0;
+};
+
+// Per-thread batch being filled. Only touched by its own thread, so the free
+// path takes no locks until the batch is full.
+struct __nxsan_quarantine_cache {
+  uint64_t generation = 0;
+  __nxsan_quarantine_batch *batch = nullptr;
+  ~__nxsan_quarantine_cache();
+};
+
+// Global FIFO of full batches, oldest first, guarded by the quarantine lock.
+static std::mutex __nxsan_quarantine_lock;
+static __nxsan_quarantine_batch *__nxsan_quarantine_head = nullptr;
+static __nxsan_quarantine_batch *__nxsan_quarantine_tail = nullptr;
+static size_t __nxsan_quarantine_bytes = 0;
+
+// Incremented on termination, invalidating all thread batches.
+static std::atomic<uint64_t> __nxsan_quarantine_generation{0};
+static thread_local __nxsan_quarantine_cache __nxsan_qcache;
+
+// Returns every chunk within the given batch to the allocator.
+static void __nxsan_recycle_batch(__nxsan_quarantine_batch *batch) {
+  for (size_t i = 0; i < batch->count; i++) {
+    __nxsan_chunk_meta *meta = __nxsan_region_get_meta(batch->chunks[i]);
+    meta->state = __NXSAN_CHUNK_FREE;
+    __nxsan_region_free(batch->chunks[i]);
+  }
+  delete batch;
+}
+
+// Moves the given batch to the global quarantine, then recycles the oldest
+// batches until the quarantine is back within its budget.
+static void __nxsan_quarantine_push(__nxsan_quarantine_batch *batch) {
+  __nxsan_quarantine_batch *evicted = nullptr;
+  {
+    std::lock_guard<std::mutex> guard(__nxsan_quarantine_lock);
+    if (__nxsan_quarantine_tail) {
+      __nxsan_quarantine_tail->next = batch;
+    } else {
+      __nxsan_quarantine_head = batch;
+    }
+    __nxsan_quarantine_tail = batch;
+    __nxsan_quarantine_bytes += batch->bytes;
+
+    // Detach the oldest batches over budget, recycling them outside the lock.
+    __nxsan_quarantine_batch **evictedTail = &evicted;
+    while (__nxsan_quarantine_bytes > __nxsan_flags.quarantineSize) {
+      __nxsan_quarantine_batch *oldest = __nxsan_quarantine_head;
+      __nxsan_quarantine_head = oldest->next;
+      if (!__nxsan_quarantine_head) {
+        __nxsan_quarantine_tail = nullptr;
+      }
+      __nxsan_quarantine_bytes -= oldest->bytes;
+      oldest->next = nullptr;
+      *evictedTail = oldest;
+      evictedTail = &oldest->next;
+    }
+  }
+
+  while (evicted) {
+    __nxsan_quarantine_batch *next = evicted->next;
+    __nxsan_recycle_batch(evicted);
+    evicted = next;
+  }
+}
+
+__nxsan_quarantine_cache::~__nxsan_quarantine_cache() {
+  // Hand any partial batch to the global quarantine, unless it belongs to a
+  // previous initialisation.
+  if (!batch) {
+    return;
+  }
+  if (generation !=
+      __nxsan_quarantine_generation.load(std::memory_order_relaxed)) {
+    delete batch;
+    return;
+  }
+  __nxsan_quarantine_push(batch);
+}
+
+void __nxsan_quarantine_put(void *ptr, size_t size) {
+  // Chunks which could never fit are recycled immediately.
+  if (size > __nxsan_flags.quarantineSize) {
+    __nxsan_region_get_meta(ptr)->state = __NXSAN_CHUNK_FREE;
+    __nxsan_region_free(ptr);
+    return;
+  }
+
+  __nxsan_quarantine_cache &cache = __nxsan_qcache;
+  uint64_t generation =
+      __nxsan_quarantine_generation.load(std::memory_order_relaxed);
+  if (__builtin_expect(cache.generation != generation, 0)) {
+    delete cache.batch;
+    cache.batch = nullptr;
+    cache.generation = generation;
+  }
+  if (!cache.batch) {
+    cache.batch = new __nxsan_quarantine_batch();
+  }
+
+  __nxsan_quarantine_batch *batch = cache.batch;
+  batch->chunks[batch->count++] = ptr;
+  batch->bytes += size;
+  if (batch->count == __NXSAN_QUARANTINE_BATCH_CHUNKS ||
+      batch->bytes >= __NXSAN_QUARANTINE_BATCH_BYTES) {
+    cache.batch = nullptr;
+    __nxsan_quarantine_push(batch);
+  }
+}
+
+size_t __nxsan_quarantine_get_bytes() {
+  std::lock_guard<std::mutex> guard(__nxsan_quarantine_lock);
+  return __nxsan_quarantine_bytes;
+}
+
+void __nxsan_quarantine_terminate() {
+  // The chunks themselves are released with the rest of the tracked heap.
+  std::lock_guard<std::mutex> guard(__nxsan_quarantine_lock);
+  while (__nxsan_quarantine_head) {
+    __nxsan_quarantine_batch *next = __nxsan_quarantine_head->next;
+    delete __nxsan_quarantine_head;
+    __nxsan_quarantine_head = next;
+  }
+  __nxsan_quarantine_tail = nullptr;
+  __nxsan_quarantine_bytes = 0;
+  __nxsan_quarantine_generation.fetch_add(1, std::memory_order_relaxed);
+}
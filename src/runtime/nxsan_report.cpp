@@ -1,10 +1,14 @@
 #include "runtime/nxsan_internal.h"
 #include "runtime/nxsan_runtime.h"
 
+#include <algorithm>
+#include <cstring>
+
 // Access type codes for reporting.
 #define NXSAN_ACCESS_TYPE_UNK 0
 #define NXSAN_ACCESS_TYPE_LOAD 1
 #define NXSAN_ACCESS_TYPE_STORE 2
+#define NXSAN_ACCESS_TYPE_RMW 3
 
 // Verifies a multi-byte access to a given pointer.
 static inline __attribute__((always_inline)) uint8_t
@@ -79,75 +83,221 @@ __nxsan_get_access_type_name(uint8_t accessType) {
     return "load";
   case NXSAN_ACCESS_TYPE_STORE:
     return "store";
+  case NXSAN_ACCESS_TYPE_RMW:
+    return "atomic read-modify-write";
   default:
     return "(unk)";
   }
 }
 
-// Verifies the result returned by verify_ptr or verify_access.
-// If an error is discovered, aborts with the appropriate error message.
-static inline __attribute__((always_inline)) void
-__nxsan_report_access(void *ptr, uint8_t size, uint8_t accessType) {
-  // Don't check if not initialised yet.'
-  if (!__nxsan_check_init()) {
-    return;
+// Verifies an access spanning a contiguous range of memory in a single pass
+// over the shadow. Every granule but the final one must carry the pointer tag,
+// while the final granule may be a short granule. On failure, badPtr is set to
+// the (tagged) address of the first offending granule.
+static inline __attribute__((always_inline)) uint8_t
+__nxsan_verify_range(void *ptr, size_t len, void **badPtr) {
+  *badPtr = ptr;
+  uint8_t tag = __NXSAN_EXTRACT_TAG(ptr);
+  uint8_t *start = (uint8_t *)__NXSAN_REMOVE_TAG(ptr);
+  uint8_t *last = start + (len > 0 ? len - 1 : 0);
+
+  // Ranges within a granule are a single access.
+  if (len <= __NXSAN_TAG_GRANULARITY_BYTES &&
+      (uint64_t)start / __NXSAN_TAG_GRANULARITY_BYTES ==
+          (uint64_t)last / __NXSAN_TAG_GRANULARITY_BYTES) {
+    return __nxsan_verify_access(ptr, (uint8_t)std::max(len, (size_t)1));
   }
 
-  // Verify access, handle errors.
-  switch (__nxsan_verify_access(ptr, size)) {
+  // Null page, untagged & out of heap checks for the whole range.
+  if ((uint64_t)start < __NXSAN_PAGE_SIZE_BYTES) {
+    return __NXSAN_PTR_NULLPAGE;
+  }
+  if (tag == 0) {
+    return __NXSAN_PTR_NOTAG;
+  }
+  if (!__nxsan_ptr_in_heap_bounds(start) ||
+      !__nxsan_ptr_in_heap_bounds(last)) {
+    return __NXSAN_PTR_OUT_OF_HEAP;
+  }
+
+  // Walk the shadow for all granules before the final one. On a mismatch,
+  // verify the remainder of the offending granule to classify the error.
+  uint8_t *shadowStart = __nxsan_get_shadow_address(start);
+  uint8_t *shadowLast = __nxsan_get_shadow_address(last);
+  size_t numGranules = shadowLast - shadowStart;
+  size_t mismatch = __nxsan_shadow_find_mismatch(shadowStart, tag, numGranules);
+  if (mismatch < numGranules) {
+    uint8_t *shadowAddr = shadowStart + mismatch;
+    uint8_t *granule =
+        __nxsan_heap_base +
+        (shadowAddr - __nxsan_shadow) * __NXSAN_TAG_GRANULARITY_BYTES;
+    uint8_t *granuleStart = std::max(start, granule);
+    *badPtr = __NXSAN_EMPLACE_TAG(granuleStart, tag);
+    uint8_t result = __nxsan_verify_access(
+        *badPtr, (uint8_t)(granule + __NXSAN_TAG_GRANULARITY_BYTES -
+                           granuleStart));
+
+    // The range continues past this granule, so it can never be a valid short
+    // granule, even when the short granule tag accepts the final byte.
+    return result == __NXSAN_PTR_OK ? __NXSAN_PTR_OVERRUN : result;
+  }
+
+  // The final granule may be a short granule, verify it directly.
+  uint8_t *lastGranule =
+      last - ((uint64_t)last % __NXSAN_TAG_GRANULARITY_BYTES);
+  *badPtr = __NXSAN_EMPLACE_TAG(lastGranule, tag);
+  return __nxsan_verify_access(*badPtr, (uint8_t)(last - lastGranule + 1));
+}
+
+// Verifies the result returned by verify_ptr, verify_access or verify_range.
+// If an error is discovered, aborts with the appropriate error message.
+static inline __attribute__((always_inline)) void
+__nxsan_report_result(void *ptr, uint8_t result, size_t size,
+                      uint8_t accessType) {
+  switch (result) {
   // Allow untagged accesses.
   case __NXSAN_PTR_OK:
   case __NXSAN_PTR_NOTAG:
     return;
 
   case __NXSAN_PTR_BADTAG:
-    __nxsan_abort_with_access_err(
+    __NXSAN_REPORT_ACCESS_ERR(
         ptr,
-        "Tag mismatch for heap memory access (attempted %s of %u bytes) "
+        "Tag mismatch for heap memory access (attempted %s of %zu bytes) "
         "(nxsan-tag-mismatch).",
         __nxsan_get_access_type_name(accessType), size);
     return;
 
   case __NXSAN_PTR_FREED:
-    __nxsan_abort_with_access_err(
+    __NXSAN_REPORT_ACCESS_ERR(
         ptr,
-        "Access to unallocated memory (attempted %s of %u bytes) "
+        "Access to unallocated memory (attempted %s of %zu bytes) "
         "(nxsan-use-after-free).",
         __nxsan_get_access_type_name(accessType), size);
     return;
 
   case __NXSAN_PTR_OUT_OF_HEAP:
-    __nxsan_abort_with_access_err(ptr,
-                                  "Access outside of heap (attempted %s of %u "
-                                  "bytes) (nxsan-not-in-heap).",
-                                  __nxsan_get_access_type_name(accessType),
-                                  size);
+    __NXSAN_REPORT_ACCESS_ERR(ptr,
+                              "Access outside of heap (attempted %s of %zu "
+                              "bytes) (nxsan-not-in-heap).",
+                              __nxsan_get_access_type_name(accessType),
+                              size);
     return;
 
   case __NXSAN_PTR_OVERRUN:
-    __nxsan_abort_with_access_err(ptr,
-                                  "Heap buffer overrun (attempted %s of %u "
-                                  "bytes) (nxsan-heap-buffer-overflow).",
-                                  __nxsan_get_access_type_name(accessType),
-                                  size);
+    __NXSAN_REPORT_ACCESS_ERR(ptr,
+                              "Heap buffer overrun (attempted %s of %zu "
+                              "bytes) (nxsan-heap-buffer-overflow).",
+                              __nxsan_get_access_type_name(accessType),
+                              size);
     return;
 
   case __NXSAN_PTR_NULLPAGE:
-    __nxsan_abort_with_access_err(ptr,
-                                  "Access at nullpage (attempted %s of %u "
-                                  "bytes) (nxsan-heap-buffer-overflow).",
-                                  __nxsan_get_access_type_name(accessType),
-                                  size);
+    __NXSAN_REPORT_ACCESS_ERR(ptr,
+                              "Access at nullpage (attempted %s of %zu "
+                              "bytes) (nxsan-heap-buffer-overflow).",
+                              __nxsan_get_access_type_name(accessType),
+                              size);
     return;
 
   default:
-    __nxsan_abort_with_access_err(ptr,
-                                  "Unimplemented access error (attempted %s of "
-                                  "%u bytes) (nxsan-unimpl-err).",
-                                  __nxsan_get_access_type_name(accessType),
-                                  size);
+    __NXSAN_REPORT_ACCESS_ERR(ptr,
+                              "Unimplemented access error (attempted %s of "
+                              "%zu bytes) (nxsan-unimpl-err).",
+                              __nxsan_get_access_type_name(accessType),
+                              size);
+    return;
+  }
+}
+
+// Defined here rather than with the flags so that it is always linked in
+// alongside the instruments which use it.
+__attribute__((tls_model("initial-exec")))
+thread_local uint64_t __nxsan_sample_countdown = 0;
+
+// Returns whether the current access should be verified. Skips accesses while
+// the thread's countdown is non-zero, then rearms it from the sample rate.
+// Without sampling, the countdown is never touched.
+static inline __attribute__((always_inline)) bool __nxsan_sample_access() {
+  if (__builtin_expect(__nxsan_flags.sampleRate == 1, 1)) {
+    return true;
+  }
+  uint64_t &countdown = __nxsan_sample_countdown;
+  if (countdown != 0) {
+    countdown--;
+    return false;
+  }
+  countdown = __nxsan_flags.sampleRate - 1;
+  return true;
+}
+
+// Verifies a fixed size access, reporting any errors.
+static inline __attribute__((always_inline)) void
+__nxsan_report_access(void *ptr, uint8_t size, uint8_t accessType) {
+  // Don't check if not initialised yet, or this access is not sampled.
+  if (!__nxsan_check_init() || !__nxsan_sample_access()) {
     return;
   }
+  __nxsan_report_result(ptr, __nxsan_verify_access(ptr, size), size,
+                        accessType);
+}
+
+// Verifies a single access wider than the fixed size instruments (a vector,
+// aggregate or odd-sized integer), reporting any errors. Sampled in the same
+// way as fixed size accesses.
+static inline __attribute__((always_inline)) void
+__nxsan_report_sized(void *ptr, size_t size, uint8_t accessType) {
+  // Don't check if not initialised yet, or this access is not sampled.
+  if (!__nxsan_check_init() || !__nxsan_sample_access()) {
+    return;
+  }
+  void *badPtr;
+  uint8_t result = __nxsan_verify_range(ptr, size, &badPtr);
+  __nxsan_report_result(badPtr, result, size, accessType);
+}
+
+// Verifies an access over a contiguous range, reporting any errors. Empty
+// ranges touch no memory, so are always permitted.
+static inline __attribute__((always_inline)) void
+__nxsan_report_range(void *ptr, size_t size, uint8_t accessType) {
+  // Don't check if not initialised yet, or if there is nothing to check.
+  if (!__nxsan_check_init() || size == 0) {
+    return;
+  }
+  void *badPtr;
+  uint8_t result = __nxsan_verify_range(ptr, size, &badPtr);
+  __nxsan_report_result(badPtr, result, size, accessType);
+}
+
+// Verifies the source (if any) & destination ranges of a bulk memory
+// operation, each in a single pass over the shadow. Not sampled, as a single
+// check covers the whole operation.
+static inline __attribute__((always_inline)) void
+__nxsan_report_bulk(void *dst, const void *src, size_t size) {
+  if (src) {
+    __nxsan_report_range((void *)src, size, NXSAN_ACCESS_TYPE_LOAD);
+  }
+  __nxsan_report_range(dst, size, NXSAN_ACCESS_TYPE_STORE);
+}
+
+// Bulk memory operations. Once verified, the operation itself is performed on
+// the untagged addresses, so these are usable without top byte ignore.
+extern "C" void *__nxsan_memcpy(void *dst, const void *src, size_t size) {
+  __nxsan_report_bulk(dst, src, size);
+  memcpy(__NXSAN_REMOVE_TAG(dst), __NXSAN_REMOVE_TAG(src), size);
+  return dst;
+}
+
+extern "C" void *__nxsan_memmove(void *dst, const void *src, size_t size) {
+  __nxsan_report_bulk(dst, src, size);
+  memmove(__NXSAN_REMOVE_TAG(dst), __NXSAN_REMOVE_TAG(src), size);
+  return dst;
+}
+
+extern "C" void *__nxsan_memset(void *dst, int value, size_t size) {
+  __nxsan_report_bulk(dst, nullptr, size);
+  memset(__NXSAN_REMOVE_TAG(dst), value, size);
+  return dst;
 }
 
 // External-facing instruments.
@@ -160,4 +310,20 @@ extern "C" void __nxsan_report_store8 (void *p) { __nxsan_report_access(p, 1, NX
 extern "C" void __nxsan_report_store16(void *p) { __nxsan_report_access(p, 2, NXSAN_ACCESS_TYPE_STORE); }
 extern "C" void __nxsan_report_store32(void *p) { __nxsan_report_access(p, 4, NXSAN_ACCESS_TYPE_STORE); }
 extern "C" void __nxsan_report_store64(void *p) { __nxsan_report_access(p, 8, NXSAN_ACCESS_TYPE_STORE); }
+extern "C" void __nxsan_report_load128 (void *p) { __nxsan_report_sized(p, 16, NXSAN_ACCESS_TYPE_LOAD ); }
+extern "C" void __nxsan_report_load256 (void *p) { __nxsan_report_sized(p, 32, NXSAN_ACCESS_TYPE_LOAD ); }
+extern "C" void __nxsan_report_load512 (void *p) { __nxsan_report_sized(p, 64, NXSAN_ACCESS_TYPE_LOAD ); }
+extern "C" void __nxsan_report_store128(void *p) { __nxsan_report_sized(p, 16, NXSAN_ACCESS_TYPE_STORE); }
+extern "C" void __nxsan_report_store256(void *p) { __nxsan_report_sized(p, 32, NXSAN_ACCESS_TYPE_STORE); }
+extern "C" void __nxsan_report_store512(void *p) { __nxsan_report_sized(p, 64, NXSAN_ACCESS_TYPE_STORE); }
+extern "C" void __nxsan_report_rmw8  (void *p) { __nxsan_report_access(p, 1, NXSAN_ACCESS_TYPE_RMW); }
+extern "C" void __nxsan_report_rmw16 (void *p) { __nxsan_report_access(p, 2, NXSAN_ACCESS_TYPE_RMW); }
+extern "C" void __nxsan_report_rmw32 (void *p) { __nxsan_report_access(p, 4, NXSAN_ACCESS_TYPE_RMW); }
+extern "C" void __nxsan_report_rmw64 (void *p) { __nxsan_report_access(p, 8, NXSAN_ACCESS_TYPE_RMW); }
+extern "C" void __nxsan_report_rmw128(void *p) { __nxsan_report_sized(p, 16, NXSAN_ACCESS_TYPE_RMW); }
+extern "C" void __nxsan_report_load_n (void *p, size_t size) { __nxsan_report_sized(p, size, NXSAN_ACCESS_TYPE_LOAD ); }
+extern "C" void __nxsan_report_store_n(void *p, size_t size) { __nxsan_report_sized(p, size, NXSAN_ACCESS_TYPE_STORE); }
+extern "C" void __nxsan_report_rmw_n  (void *p, size_t size) { __nxsan_report_sized(p, size, NXSAN_ACCESS_TYPE_RMW); }
+extern "C" void __nxsan_report_load_range (void *p, size_t size) { __nxsan_report_range(p, size, NXSAN_ACCESS_TYPE_LOAD ); }
+extern "C" void __nxsan_report_store_range(void *p, size_t size) { __nxsan_report_range(p, size, NXSAN_ACCESS_TYPE_STORE); }
 // clang-format on
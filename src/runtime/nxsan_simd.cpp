@@ -0,0 +1,114 @@
+#include "runtime/nxsan_internal.h"
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+// Ranges shorter than this are handled inline, as the indirect call to a
+// vector kernel would cost more than it saves.
+#define __NXSAN_SIMD_MIN_BYTES 32
+
+// Scalar shadow fill.
+static void __nxsan_shadow_fill_scalar(uint8_t *dst, uint8_t value, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    __nxsan_store_shadow(dst + i, value);
+  }
+}
+
+// Scalar search for the end of a run of tags.
+static size_t __nxsan_shadow_find_mismatch_scalar(const uint8_t *src,
+                                                  uint8_t value, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    if (__nxsan_load_shadow((uint8_t *)src + i) != value) {
+      return i;
+    }
+  }
+  return n;
+}
+
+#if defined(__x86_64__)
+// SSE2 kernels. SSE2 is part of the x86-64 baseline, so needs no CPU check.
+static void __nxsan_shadow_fill_sse2(uint8_t *dst, uint8_t value, size_t n) {
+  __m128i v = _mm_set1_epi8((char)value);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm_storeu_si128((__m128i *)(dst + i), v);
+  }
+  __nxsan_shadow_fill_scalar(dst + i, value, n - i);
+}
+
+static size_t __nxsan_shadow_find_mismatch_sse2(const uint8_t *src,
+                                                uint8_t value, size_t n) {
+  __m128i v = _mm_set1_epi8((char)value);
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)(src + i));
+    uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, v));
+    if (mask != 0xFFFF) {
+      return i + __builtin_ctz(~mask);
+    }
+  }
+  return i + __nxsan_shadow_find_mismatch_scalar(src + i, value, n - i);
+}
+
+// AVX2 kernels, only selected when the running CPU supports them.
+__attribute__((target("avx2"))) static void
+__nxsan_shadow_fill_avx2(uint8_t *dst, uint8_t value, size_t n) {
+  __m256i v = _mm256_set1_epi8((char)value);
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    _mm256_storeu_si256((__m256i *)(dst + i), v);
+  }
+  __nxsan_shadow_fill_sse2(dst + i, value, n - i);
+}
+
+__attribute__((target("avx2"))) static size_t
+__nxsan_shadow_find_mismatch_avx2(const uint8_t *src, uint8_t value, size_t n) {
+  __m256i v = _mm256_set1_epi8((char)value);
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *)(src + i));
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, v));
+    if (mask != 0xFFFFFFFF) {
+      return i + __builtin_ctz(~mask);
+    }
+  }
+  return i + __nxsan_shadow_find_mismatch_sse2(src + i, value, n - i);
+}
+#endif
+
+// Selected kernels. These start out as the portable versions, so are safe to
+// use before the runtime is initialised.
+static void (*__nxsan_shadow_fill_kernel)(uint8_t *, uint8_t,
+                                          size_t) = __nxsan_shadow_fill_scalar;
+static size_t (*__nxsan_shadow_find_mismatch_kernel)(
+    const uint8_t *, uint8_t, size_t) = __nxsan_shadow_find_mismatch_scalar;
+
+void __nxsan_init_shadow_kernels() {
+#if defined(__x86_64__)
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    __nxsan_shadow_fill_kernel = __nxsan_shadow_fill_avx2;
+    __nxsan_shadow_find_mismatch_kernel = __nxsan_shadow_find_mismatch_avx2;
+  } else {
+    __nxsan_shadow_fill_kernel = __nxsan_shadow_fill_sse2;
+    __nxsan_shadow_find_mismatch_kernel = __nxsan_shadow_find_mismatch_sse2;
+  }
+#endif
+}
+
+void __nxsan_shadow_fill(uint8_t *dst, uint8_t value, size_t n) {
+  if (n < __NXSAN_SIMD_MIN_BYTES) {
+    __nxsan_shadow_fill_scalar(dst, value, n);
+    return;
+  }
+  __nxsan_shadow_fill_kernel(dst, value, n);
+}
+
+size_t __nxsan_shadow_find_mismatch(const uint8_t *src, uint8_t value,
+                                    size_t n) {
+  if (n < __NXSAN_SIMD_MIN_BYTES) {
+    return __nxsan_shadow_find_mismatch_scalar(src, value, n);
+  }
+  return __nxsan_shadow_find_mismatch_kernel(src, value, n);
+}
@@ -0,0 +1,137 @@
+#include "runtime/nxsan_internal.h"
+
+#include <algorithm>
+#include <atomic>
+
+// Total size of the depot's record arena. Once full, new stacks are no longer
+// recorded, so the depot's footprint is bounded. Pages are only committed as
+// records are written.
+#ifndef __NXSAN_DEPOT_SIZE_BYTES
+#define __NXSAN_DEPOT_SIZE_BYTES (16 * 1024 * 1024)
+#endif
+
+// Number of hash buckets in the depot. Must be a power of two.
+#define __NXSAN_DEPOT_NUM_BUCKETS (1 << 16)
+
+// Words in the arena, and words used by each record's header.
+#define __NXSAN_DEPOT_ARENA_WORDS (__NXSAN_DEPOT_SIZE_BYTES / sizeof(uint64_t))
+#define __NXSAN_DEPOT_HEADER_WORDS 2
+
+// A record in the arena is laid out as:
+//   [0] hash of the stack
+//   [1] number of PCs (low 32 bits), id of the next record in the bucket (high
+//       32 bits)
+//   [2..] PCs
+// The id of a record is its word offset in the arena, so id 0 (which is never
+// handed out) means "no stack".
+static uint64_t __nxsan_depot_arena[__NXSAN_DEPOT_ARENA_WORDS];
+static std::atomic<uint64_t> __nxsan_depot_cursor{1};
+static std::atomic<uint32_t> __nxsan_depot_buckets[__NXSAN_DEPOT_NUM_BUCKETS];
+
+static_assert(__NXSAN_DEPOT_ARENA_WORDS <= UINT32_MAX,
+              "Depot record ids must fit within 32 bits.");
+
+// Hashes the given PCs (MurmurHash64A-style mixing).
+static inline __attribute__((always_inline)) uint64_t
+__nxsan_depot_hash(void *const *pcs, size_t size) {
+  const uint64_t m = 0xC6A4A7935BD1E995ull;
+  uint64_t h = size * m;
+  for (size_t i = 0; i < size; i++) {
+    uint64_t k = (uint64_t)pcs[i] * m;
+    k ^= k >> 47;
+    h = (h ^ (k * m)) * m;
+  }
+  h ^= h >> 47;
+  return h ? h : 1;
+}
+
+// Returns whether the record with the given id holds the given stack.
+static inline __attribute__((always_inline)) bool
+__nxsan_depot_matches(uint32_t id, uint64_t hash, void *const *pcs,
+                      size_t size) {
+  const uint64_t *record = __nxsan_depot_arena + id;
+  if (record[0] != hash || (uint32_t)record[1] != size) {
+    return false;
+  }
+  for (size_t i = 0; i < size; i++) {
+    if (record[__NXSAN_DEPOT_HEADER_WORDS + i] != (uint64_t)pcs[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Searches a bucket chain from the given record up to (not including) the end
+// record for the given stack. Returns its id, or 0 if not found.
+static inline __attribute__((always_inline)) uint32_t
+__nxsan_depot_find(uint32_t id, uint32_t end, uint64_t hash, void *const *pcs,
+                   size_t size) {
+  for (; id != end; id = (uint32_t)(__nxsan_depot_arena[id + 1] >> 32)) {
+    if (__nxsan_depot_matches(id, hash, pcs, size)) {
+      return id;
+    }
+  }
+  return 0;
+}
+
+uint32_t __nxsan_depot_put(void *const *pcs, size_t size) {
+  if (size == 0 || size > UINT32_MAX) {
+    return 0;
+  }
+  uint64_t hash = __nxsan_depot_hash(pcs, size);
+  std::atomic<uint32_t> &bucket =
+      __nxsan_depot_buckets[hash & (__NXSAN_DEPOT_NUM_BUCKETS - 1)];
+
+  // Fast path: the stack has been seen before.
+  uint32_t head = bucket.load(std::memory_order_acquire);
+  uint32_t found = __nxsan_depot_find(head, 0, hash, pcs, size);
+  if (found) {
+    return found;
+  }
+
+  // Carve a new record. Words are never reclaimed, so a record abandoned after
+  // losing a race is simply wasted.
+  uint64_t words = __NXSAN_DEPOT_HEADER_WORDS + size;
+  uint64_t id = __nxsan_depot_cursor.fetch_add(words, std::memory_order_relaxed);
+  if (id + words > __NXSAN_DEPOT_ARENA_WORDS) {
+    return 0;
+  }
+  uint64_t *record = __nxsan_depot_arena + id;
+  record[0] = hash;
+  for (size_t i = 0; i < size; i++) {
+    record[__NXSAN_DEPOT_HEADER_WORDS + i] = (uint64_t)pcs[i];
+  }
+
+  // Publish the record at the head of the bucket. If another thread got there
+  // first, check whether it published the same stack.
+  while (true) {
+    record[1] = ((uint64_t)head << 32) | size;
+    uint32_t expected = head;
+    if (bucket.compare_exchange_weak(expected, (uint32_t)id,
+                                     std::memory_order_release,
+                                     std::memory_order_acquire)) {
+      return (uint32_t)id;
+    }
+    found = __nxsan_depot_find(expected, head, hash, pcs, size);
+    if (found) {
+      return found;
+    }
+    head = expected;
+  }
+}
+
+size_t __nxsan_depot_get_used_bytes() {
+  uint64_t words = __nxsan_depot_cursor.load(std::memory_order_relaxed);
+  return std::min<uint64_t>(words, __NXSAN_DEPOT_ARENA_WORDS) *
+         sizeof(uint64_t);
+}
+
+size_t __nxsan_depot_get(uint32_t id, void *const **pcs) {
+  if (id == 0 || id >= __NXSAN_DEPOT_ARENA_WORDS) {
+    *pcs = nullptr;
+    return 0;
+  }
+  const uint64_t *record = __nxsan_depot_arena + id;
+  *pcs = (void *const *)(record + __NXSAN_DEPOT_HEADER_WORDS);
+  return (uint32_t)record[1];
+}
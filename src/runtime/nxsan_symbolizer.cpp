@@ -0,0 +1,173 @@
+#include "runtime/nxsan_internal.h"
+
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <sys/types.h>
+#include <unordered_map>
+
+// Platform-specific includes.
+#ifdef linux
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <link.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Maximum size of a single response from the external symbolizer.
+#define __NXSAN_SYMBOLIZER_MAX_RESPONSE 4096
+
+// Symbolizer state, guarded by the symbolizer lock. Symbolization only happens
+// when printing reports, so a single lock is sufficient.
+static std::mutex __nxsan_symbolizer_lock;
+static std::unordered_map<void*, std::string> __nxsan_symbolizer_cache;
+static bool __nxsan_symbolizer_started = false;
+static int __nxsan_symbolizer_fd = -1;
+static pid_t __nxsan_symbolizer_pid = -1;
+
+#ifdef linux
+// Starts the external symbolizer if one is configured, talking to it over a
+// socket so that a dead symbolizer cannot raise SIGPIPE.
+static void __nxsan_start_symbolizer() {
+  __nxsan_symbolizer_started = true;
+  const char* path = __nxsan_flags.symbolizerPath;
+  if (!path) {
+    return;
+  }
+
+  int fds[2];
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+    return;
+  }
+  const char* argv[] = {path, "--no-inlines", "--demangle", nullptr};
+  pid_t pid = fork();
+  if (pid < 0) {
+    close(fds[0]);
+    close(fds[1]);
+    return;
+  }
+  if (pid == 0) {
+    // Only async-signal-safe calls until exec.
+    dup2(fds[1], STDIN_FILENO);
+    dup2(fds[1], STDOUT_FILENO);
+    close(fds[0]);
+    close(fds[1]);
+    execv(path, (char* const*)argv);
+    _exit(1);
+  }
+  close(fds[1]);
+  __nxsan_symbolizer_fd = fds[0];
+  __nxsan_symbolizer_pid = pid;
+}
+
+// Shuts down the external symbolizer after a failed exchange, falling back to
+// dladdr for the remaining PCs.
+static void __nxsan_stop_symbolizer() {
+  close(__nxsan_symbolizer_fd);
+  waitpid(__nxsan_symbolizer_pid, nullptr, 0);
+  __nxsan_symbolizer_fd = -1;
+  __nxsan_symbolizer_pid = -1;
+}
+
+// Asks the external symbolizer for the function & source location of the
+// given module offset. Returns false if no useful information is available.
+static bool __nxsan_query_symbolizer(const char* module, uint64_t offset, std::string& function,
+                                     std::string& location) {
+  char request[PATH_MAX + 32];
+  int len = snprintf(request, sizeof(request), "%s 0x%lx\n", module, offset);
+  if (len <= 0 || (size_t)len >= sizeof(request) ||
+      send(__nxsan_symbolizer_fd, request, len, MSG_NOSIGNAL) != len) {
+    __nxsan_stop_symbolizer();
+    return false;
+  }
+
+  // Responses are a function line & a location line, terminated by a blank line.
+  char response[__NXSAN_SYMBOLIZER_MAX_RESPONSE];
+  size_t size = 0;
+  while (size < 2 || response[size - 1] != '\n' || response[size - 2] != '\n') {
+    ssize_t n = recv(__nxsan_symbolizer_fd, response + size, sizeof(response) - 1 - size, 0);
+    if (n <= 0 || size + n >= sizeof(response) - 1) {
+      __nxsan_stop_symbolizer();
+      return false;
+    }
+    size += n;
+  }
+  response[size] = '\0';
+
+  char* lineEnd = strchr(response, '\n');
+  function.assign(response, lineEnd - response);
+  char* locEnd = strchr(lineEnd + 1, '\n');
+  location.assign(lineEnd + 1, locEnd - lineEnd - 1);
+  if (location.rfind("??", 0) == 0) {
+    location.clear();
+  }
+  if (function == "??") {
+    function.clear();
+  }
+  return !function.empty() || !location.empty();
+}
+#endif
+
+// Resolves the given PC, uncached.
+static std::string __nxsan_resolve_pc(void* pc) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%p", pc);
+  std::string frame = buf;
+
+#ifdef linux
+  Dl_info info;
+  link_map* map = nullptr;
+  if (!dladdr1(pc, &info, (void**)&map, RTLD_DL_LINKMAP) || !info.dli_fname) {
+    return frame + " (missing symbol)";
+  }
+
+  // PCs are return addresses, so look up the preceding instruction for source
+  // locations.
+  const char* module = info.dli_fname;
+  uint64_t moduleOffset = (uint64_t)pc - (map ? map->l_addr : (uint64_t)info.dli_fbase);
+  std::string function, location;
+  if (!__nxsan_symbolizer_started) {
+    __nxsan_start_symbolizer();
+  }
+  if (__nxsan_symbolizer_fd >= 0) {
+    __nxsan_query_symbolizer(module, moduleOffset - 1, function, location);
+  }
+
+  // Fall back to the dynamic symbol table for function names.
+  if (function.empty() && info.dli_sname) {
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+    function = status == 0 && demangled ? demangled : info.dli_sname;
+    std::free(demangled);
+    snprintf(buf, sizeof(buf), "+0x%lx", (uint64_t)pc - (uint64_t)info.dli_saddr);
+    function += buf;
+  }
+
+  if (!function.empty()) {
+    frame += " in " + function;
+  }
+  if (!location.empty()) {
+    frame += " " + location;
+  } else {
+    snprintf(buf, sizeof(buf), "+0x%lx", moduleOffset);
+    frame += " (" + std::string(module) + buf + ")";
+  }
+  return frame;
+#else
+  return frame;
+#endif
+}
+
+std::string __nxsan_symbolize_pc(void* pc) {
+  std::lock_guard<std::mutex> guard(__nxsan_symbolizer_lock);
+  auto it = __nxsan_symbolizer_cache.find(pc);
+  if (it != __nxsan_symbolizer_cache.end()) {
+    return it->second;
+  }
+  return __nxsan_symbolizer_cache.emplace(pc, __nxsan_resolve_pc(pc)).first->second;
+}
@@ -1,13 +1,51 @@
 #include "runtime/nxsan_internal.h"
 
+#include <atomic>
 #include <cstdarg>
 #include <cstdlib>
 #include <iostream>
+#include <mutex>
 #include <stdio.h>
 
 // Header/footer for error messages.
 #define __NXSAN_ERR_HEADER "\n================================================="
 #define __NXSAN_ERR_FOOTER "=== ABORTING ==="
+#define __NXSAN_RECOVER_FOOTER "=== CONTINUING ==="
+
+// Number of slots in the set of reported (error kind, PC) pairs. Must be a power
+// of two. Once full, further distinct errors are suppressed.
+#define __NXSAN_REPORTED_SET_SIZE 4096
+
+// Set of hashed (error kind, PC) pairs already reported in recover mode. Slots
+// are claimed with a CAS, so checking for duplicates takes no locks.
+static std::atomic<uint64_t> __nxsan_reported_set[__NXSAN_REPORTED_SET_SIZE];
+
+// Serialises report output between threads.
+static std::mutex __nxsan_report_lock;
+static uint64_t __nxsan_num_reports = 0;
+
+// Marks the given error as reported, returning whether it was reported before.
+static bool __nxsan_check_reported(const void* kind, void* pc) {
+  uint64_t key = ((uint64_t)kind * 0x9E3779B97F4A7C15ull) ^ (uint64_t)pc;
+  key ^= key >> 31;
+  key = key ? key : 1;
+  for (size_t i = 0; i < __NXSAN_REPORTED_SET_SIZE; i++) {
+    std::atomic<uint64_t>& slot = __nxsan_reported_set[(key + i) & (__NXSAN_REPORTED_SET_SIZE - 1)];
+    uint64_t current = slot.load(std::memory_order_relaxed);
+    if (current == key) {
+      return true;
+    }
+    if (current == 0) {
+      if (slot.compare_exchange_strong(current, key, std::memory_order_relaxed)) {
+        return false;
+      }
+      if (current == key) {
+        return true;
+      }
+    }
+  }
+  return true;
+}
 
 // Aborts the application.
 static inline __attribute__((always_inline)) void
@@ -15,8 +53,70 @@ __nxsan_abort(void) {
   std::abort();
 }
 
-void __nxsan_abort_with_access_err(void* ptr, const char* fmt, ...) {
+// Finds the chunk a tagged pointer most likely refers to: the chunk containing
+// it, or the chunk before it if only that carries the pointer's tag (such as
+// for an overflow off the end of an allocation).
+static __nxsan_chunk_meta* __nxsan_find_accessed_chunk(void* ptr, void** chunk) {
+  uint8_t tag = __NXSAN_EXTRACT_TAG(ptr);
+  ptr = __NXSAN_REMOVE_TAG(ptr);
+  __nxsan_chunk_meta* meta = __nxsan_region_find_chunk(ptr, chunk);
+  if (!meta || (meta->state != __NXSAN_CHUNK_FREE && meta->tag == tag)) {
+    return meta;
+  }
+
+  void* prevChunk;
+  __nxsan_chunk_meta* prevMeta = __nxsan_region_find_chunk((uint8_t*)*chunk - 1, &prevChunk);
+  if (prevMeta && prevMeta->state != __NXSAN_CHUNK_FREE && prevMeta->tag == tag) {
+    *chunk = prevChunk;
+    return prevMeta;
+  }
+  return meta;
+}
+
+// Describes the allocation the given tagged pointer refers to, along with where
+// it was allocated and freed, if known.
+static void __nxsan_describe_chunk(void* ptr) {
+  void* chunk;
+  __nxsan_chunk_meta* meta = __nxsan_find_accessed_chunk(ptr, &chunk);
+  if (!meta || meta->state == __NXSAN_CHUNK_FREE) {
+    return;
+  }
+
+  ptr = __NXSAN_REMOVE_TAG(ptr);
+  size_t offset = (uint8_t*)ptr - (uint8_t*)chunk;
+  size_t size = meta->size;
+  if (offset < size) {
+    fprintf(stderr, "%p is located %zu bytes inside of %zu-byte region [%p, %p)\n", ptr, offset, size, chunk,
+            (uint8_t*)chunk + size);
+  } else {
+    fprintf(stderr, "%p is located %zu bytes to the right of %zu-byte region [%p, %p)\n", ptr, offset - size, size,
+            chunk, (uint8_t*)chunk + size);
+  }
+
+  if (meta->state == __NXSAN_CHUNK_QUARANTINED) {
+    std::cerr << "freed by:" << std::endl << __nxsan_format_stack(meta->freeStack) << std::endl;
+    std::cerr << "previously allocated by:" << std::endl;
+  } else {
+    std::cerr << "allocated by:" << std::endl;
+  }
+  std::cerr << __nxsan_format_stack(meta->allocStack) << std::endl;
+}
+
+uint64_t __nxsan_get_num_reports() {
+  std::lock_guard<std::mutex> guard(__nxsan_report_lock);
+  return __nxsan_num_reports;
+}
+
+void __nxsan_report_access_err(void* pc, void* ptr, const char* fmt, ...) {
+  // In recover mode, only report each kind of error from each PC once.
+  if (__nxsan_flags.recover && __nxsan_check_reported(fmt, pc)) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(__nxsan_report_lock);
+  __nxsan_num_reports++;
+
   // Strip tag from pointer for display.
+  void* taggedPtr = ptr;
   ptr = __NXSAN_REMOVE_TAG(ptr);
 
   // Output header w/ location of illegal access.
@@ -36,7 +136,13 @@ void __nxsan_abort_with_access_err(void* ptr, const char* fmt, ...) {
   std::cerr << __nxsan_bt() << std::endl;
 
   // If available, show where memory was previously allocated/freed.
-  // ... todo ...
+  __nxsan_describe_chunk(taggedPtr);
+
+  // In recover mode, carry on as if the access were valid.
+  if (__nxsan_flags.recover) {
+    std::cerr << __NXSAN_RECOVER_FOOTER << std::endl;
+    return;
+  }
 
   // Output footer.
   std::cerr << __NXSAN_ERR_FOOTER << std::endl;
@@ -68,3 +174,35 @@ void __nxsan_abort_with_err(const char* fmt, ...) {
   // Abort.
   __nxsan_abort();
 }
+
+void __nxsan_report_err(const char* fmt, ...) {
+  std::lock_guard<std::mutex> guard(__nxsan_report_lock);
+
+  // Output header.
+  std::cerr << __NXSAN_ERR_HEADER << std::endl;
+  std::cerr << "ERROR: NxSanitizer: ";
+
+  // Output format string to stderr.
+  va_list argptr;
+  va_start(argptr, fmt);
+  vfprintf(stderr, fmt, argptr);
+  va_end(argptr);
+
+  // End line.
+  std::cerr << std::endl;
+
+  // Show backtrace for error.
+  std::cerr << __nxsan_bt() << std::endl;
+
+  // In recover mode, carry on.
+  if (__nxsan_flags.recover) {
+    std::cerr << __NXSAN_RECOVER_FOOTER << std::endl;
+    return;
+  }
+
+  // Output footer.
+  std::cerr << __NXSAN_ERR_FOOTER << std::endl;
+
+  // Abort.
+  __nxsan_abort();
+}
@@ -0,0 +1,97 @@
+#include <gtest/gtest.h>
+#include <llvm/AsmParser/Parser.h>
+#include <llvm/IR/LLVMContext.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/SourceMgr.h>
+
+#include "instrumentation/AccessInstrumenter.hpp"
+
+// Copies the first three fields of a struct, which coalesces into one load &
+// one store range check by default.
+static const char *s_structCopyIr = R"(
+target datalayout = "e-m:e-p270:32:32-p271:32:32-p272:64:64-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-pc-linux-gnu"
+%S = type { i32, i64, i64 }
+define void @copy(%S* %d, %S* %s) {
+  %s0 = getelementptr %S, %S* %s, i64 0, i32 0
+  %s1 = getelementptr %S, %S* %s, i64 0, i32 1
+  %s2 = getelementptr %S, %S* %s, i64 0, i32 2
+  %d0 = getelementptr %S, %S* %d, i64 0, i32 0
+  %d1 = getelementptr %S, %S* %d, i64 0, i32 1
+  %d2 = getelementptr %S, %S* %d, i64 0, i32 2
+  %v0 = load i32, i32* %s0
+  store i32 %v0, i32* %d0
+  %v1 = load i64, i64* %s1
+  store i64 %v1, i64* %d1
+  %v2 = load i64, i64* %s2
+  store i64 %v2, i64* %d2
+  ret void
+}
+)";
+
+// Instruments the struct copy with the given options, returning the results
+// & whether any range instrument ended up being called.
+static nxsan::InstrumentedIr
+InstrumentStructCopy(const nxsan::InstrumenterOptions &options,
+                     bool *callsRange) {
+  llvm::LLVMContext ctx;
+  llvm::SMDiagnostic err;
+  std::unique_ptr<llvm::Module> mod =
+      llvm::parseAssemblyString(s_structCopyIr, err, ctx);
+  EXPECT_NE(mod, nullptr);
+  nxsan::InstrumentedIr result =
+      nxsan::AccessInstrumenter(options).InstrumentModule(*mod);
+  *callsRange = false;
+  for (const char *name :
+       {"__nxsan_report_load_range", "__nxsan_report_store_range"}) {
+    llvm::Function *range = mod->getFunction(name);
+    *callsRange |= range && !range->use_empty();
+  }
+  return result;
+}
+
+// Nearby accesses from the same pointer share a range check by default.
+TEST(Coalesce, MergesByDefault) {
+  bool callsRange;
+  nxsan::InstrumentedIr result = InstrumentStructCopy({}, &callsRange);
+  EXPECT_EQ(result.numLoads, 0u);
+  EXPECT_EQ(result.numStores, 0u);
+  EXPECT_EQ(result.numCoalescedChecks, 6u);
+  EXPECT_TRUE(callsRange);
+}
+
+// Range checks are never sampled, so sampled accesses keep their own checks.
+TEST(Coalesce, SkippedWithSampleChecks) {
+  nxsan::InstrumenterOptions options;
+  options.sampleChecks = true;
+  bool callsRange;
+  nxsan::InstrumentedIr result = InstrumentStructCopy(options, &callsRange);
+  EXPECT_EQ(result.numLoads, 3u);
+  EXPECT_EQ(result.numStores, 3u);
+  EXPECT_EQ(result.numCoalescedChecks, 0u);
+  EXPECT_FALSE(callsRange);
+}
+
+// Range checks are always out of line, so inlined accesses keep their own
+// checks.
+TEST(Coalesce, SkippedWithInlineChecks) {
+  nxsan::InstrumenterOptions options;
+  options.inlineChecks = true;
+  bool callsRange;
+  nxsan::InstrumentedIr result = InstrumentStructCopy(options, &callsRange);
+  EXPECT_EQ(result.numLoads, 3u);
+  EXPECT_EQ(result.numStores, 3u);
+  EXPECT_EQ(result.numCoalescedChecks, 0u);
+  EXPECT_FALSE(callsRange);
+}
+
+// Sampled inline checks are left alone too.
+TEST(Coalesce, SkippedWithSampledInlineChecks) {
+  nxsan::InstrumenterOptions options;
+  options.sampleChecks = true;
+  options.inlineChecks = true;
+  bool callsRange;
+  nxsan::InstrumentedIr result = InstrumentStructCopy(options, &callsRange);
+  EXPECT_EQ(result.numCoalescedChecks, 0u);
+  EXPECT_FALSE(callsRange);
+}
@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 
 #include "runtime/nxsan_runtime.h"
+#include "runtime/nxsan_internal.h"
 
 // Ensure initialisation does not work twice.
 TEST(RuntimeInit, NoDoubleInit) {
@@ -36,3 +37,40 @@ TEST(RuntimeInit, HeapTailCheck) {
   GTEST_FLAG_SET(death_test_style, "threadsafe");
   ASSERT_DEATH(__nxsan_init((void*)0xFFFFFFFFFFFFFFFF, 0xFFFF), "");
 }
+
+// Ensure shadow memory is zeroed when re-initialised after termination.
+TEST(RuntimeInit, ShadowZeroedOnReinit) {
+  GTEST_FLAG_SET(death_test_style, "threadsafe");
+  EXPECT_TRUE(__nxsan_init((void*)0x0, 0xFFFFFFFF));
+  __nxsan_shadow[0] = 0xAB;
+  __nxsan_shadow[__nxsan_shadow_size - 1] = 0xCD;
+  EXPECT_TRUE(__nxsan_terminate());
+
+  EXPECT_TRUE(__nxsan_init((void*)0x0, 0xFFFFFFFF));
+  EXPECT_EQ(__nxsan_shadow[0], 0x0);
+  EXPECT_EQ(__nxsan_shadow[__nxsan_shadow_size - 1], 0x0);
+  EXPECT_TRUE(__nxsan_terminate());
+}
+
+// Ensure runtime options are parsed from the environment on init.
+TEST(RuntimeInit, ParsesOptions) {
+  GTEST_FLAG_SET(death_test_style, "threadsafe");
+  setenv("NXSAN_OPTIONS", "recover=1:quarantine_size_mb=2,bt_depth=8 stats_path=-:bogus=1:alloc_bt_depth=x:sample_rate=0", 1);
+  EXPECT_TRUE(__nxsan_init((void*)0x0, 0xFFFF));
+  EXPECT_TRUE(__nxsan_flags.recover);
+  EXPECT_EQ(__nxsan_flags.quarantineSize, 2 * 1024 * 1024);
+  EXPECT_EQ(__nxsan_flags.btDepth, 8);
+  EXPECT_STREQ(__nxsan_flags.statsPath, "-");
+  EXPECT_EQ(__nxsan_flags.allocBtDepth, 16);
+  EXPECT_EQ(__nxsan_flags.sampleRate, 1);
+  EXPECT_EQ(__nxsan_flags.symbolizerPath, nullptr);
+  EXPECT_TRUE(__nxsan_terminate());
+
+  // Flags return to their defaults when the options are removed.
+  unsetenv("NXSAN_OPTIONS");
+  EXPECT_TRUE(__nxsan_init((void*)0x0, 0xFFFF));
+  EXPECT_FALSE(__nxsan_flags.recover);
+  EXPECT_EQ(__nxsan_flags.btDepth, 64);
+  EXPECT_EQ(__nxsan_flags.statsPath, nullptr);
+  EXPECT_TRUE(__nxsan_terminate());
+}
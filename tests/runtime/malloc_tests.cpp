@@ -1,4 +1,6 @@
 #include <gtest/gtest.h>
+#include <thread>
+#include <vector>
 
 #define __NXSAN_OUTLINE_REPORTING
 #include "runtime/nxsan_runtime.h"
@@ -13,7 +15,7 @@ TEST(AllocFree, SmallAllocation) {
 
   uint8_t* pt = (uint8_t*)__nxsan_malloc(8);
   __nxsan_report_load64(pt);
-  *pt = 4;
+  *(uint8_t*)__NXSAN_REMOVE_TAG(pt) = 4;
   __nxsan_free(pt);
 
   EXPECT_TRUE(__nxsan_terminate());
@@ -26,8 +28,8 @@ TEST(AllocFree, MultiGranuleAllocation) {
   uint8_t* pt = (uint8_t*)__nxsan_malloc(__NXSAN_TAG_GRANULARITY_BYTES + 6);
   __nxsan_report_load8(pt);
   __nxsan_report_load8(pt + (__NXSAN_TAG_GRANULARITY_BYTES + 5));
-  *pt = 4;
-  *(pt + __NXSAN_TAG_GRANULARITY_BYTES + 5) = 12;
+  *(uint8_t*)__NXSAN_REMOVE_TAG(pt) = 4;
+  *(uint8_t*)__NXSAN_REMOVE_TAG(pt + __NXSAN_TAG_GRANULARITY_BYTES + 5) = 12;
   __nxsan_free(pt);
 
   EXPECT_TRUE(__nxsan_terminate());
@@ -65,7 +67,7 @@ TEST(AllocFree, TagClearSingleGranule) {
 
   // Allocate & grab tag.
   uint8_t* pt = (uint8_t*)__nxsan_malloc(6);
-  *pt = 4;
+  *(uint8_t*)__NXSAN_REMOVE_TAG(pt) = 4;
   uint8_t tag = __NXSAN_EXTRACT_TAG(pt);
   EXPECT_TRUE(tag > 0x0);
 
@@ -74,7 +76,7 @@ TEST(AllocFree, TagClearSingleGranule) {
   EXPECT_TRUE(allocShadowTag == 6);
 
   // Ensure tag is set within the final byte of allocated granule.
-  uint8_t finalByteTag = *(pt + __NXSAN_TAG_GRANULARITY_BYTES - 1);
+  uint8_t finalByteTag = *(uint8_t*)__NXSAN_REMOVE_TAG(pt + __NXSAN_TAG_GRANULARITY_BYTES - 1);
   EXPECT_TRUE(finalByteTag == tag);
 
   // Free & check shadow tag is zeroed.
@@ -169,6 +171,7 @@ TEST(AllocFree, FreeUnaligned) {
   EXPECT_TRUE(__nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE));
   uint8_t* pt = (uint8_t*)__nxsan_malloc(16);
   ASSERT_DEATH(__nxsan_free(pt + 6), "nxsan-unaligned-free");
+  __nxsan_free(pt);
 }
 
 // Attempt to free shadow memory (lol).
@@ -188,8 +191,9 @@ TEST(AllocFree, FreeUntagged) {
   }
   EXPECT_TRUE(__nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE));
   uint8_t* pt = (uint8_t*)__nxsan_malloc(16);
-  pt = (uint8_t*)__NXSAN_REMOVE_TAG(pt);
-  ASSERT_DEATH(__nxsan_free(pt), "nxsan-notag-free");
+  uint8_t* untagged = (uint8_t*)__NXSAN_REMOVE_TAG(pt);
+  ASSERT_DEATH(__nxsan_free(untagged), "nxsan-notag-free");
+  __nxsan_free(pt);
 }
 
 // Attempt to free pointer with bad tag.
@@ -203,10 +207,11 @@ TEST(AllocFree, FreeBadTag) {
 
   // poison tag
   uint8_t badtag = tag == 255 ? tag - 1 : tag + 1;
-  pt = (uint8_t*)__NXSAN_REMOVE_TAG(pt);
-  pt = (uint8_t*)__NXSAN_EMPLACE_TAG(pt, badtag);
+  uint8_t* badPt = (uint8_t*)__NXSAN_REMOVE_TAG(pt);
+  badPt = (uint8_t*)__NXSAN_EMPLACE_TAG(badPt, badtag);
 
-  ASSERT_DEATH(__nxsan_free(pt), "nxsan-badtag-free");
+  ASSERT_DEATH(__nxsan_free(badPt), "nxsan-badtag-free");
+  __nxsan_free(pt);
 }
 
 // Attempt to free nullpage pointer.
@@ -239,3 +244,182 @@ TEST(AllocFree, DoubleFreeMultiGranule) {
   __nxsan_free(pt);
   ASSERT_DEATH(__nxsan_free(pt), "nxsan-double-free");
 }
+
+// Allocate & free concurrently from several threads.
+TEST(AllocFree, MultithreadedAllocation) {
+  if (__nxsan_check_init()) {
+    __nxsan_terminate();
+  }
+  EXPECT_TRUE(__nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE));
+
+  constexpr int kNumThreads = 8;
+  constexpr int kNumAllocs = 1000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([]() {
+      for (int i = 0; i < kNumAllocs; i++) {
+        uint8_t* pt = (uint8_t*)__nxsan_malloc(__NXSAN_TAG_GRANULARITY_BYTES * 2);
+        EXPECT_TRUE(__NXSAN_EXTRACT_TAG(pt) > 0x0);
+        __nxsan_report_store_range(pt, __NXSAN_TAG_GRANULARITY_BYTES * 2);
+        __nxsan_free(pt);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_TRUE(__nxsan_terminate());
+}
+
+// Allocations of all sizes are carved from within the tracked heap.
+TEST(AllocFree, AllocationWithinTrackedHeap) {
+  if (__nxsan_check_init()) {
+    __nxsan_terminate();
+  }
+  EXPECT_TRUE(__nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE));
+
+  std::vector<void*> ptrs;
+  for (size_t size : {1ul, 16ul, 17ul, 300ul, 4096ul, 16385ul, 1ul << 20}) {
+    void* pt = __nxsan_malloc(size);
+    void* ptNoTag = __NXSAN_REMOVE_TAG(pt);
+    EXPECT_TRUE(__nxsan_alloc_in_heap_bounds(ptNoTag, size));
+    EXPECT_TRUE((uint64_t)ptNoTag % __NXSAN_TAG_GRANULARITY_BYTES == 0);
+    ptrs.push_back(pt);
+  }
+  for (void* pt : ptrs) {
+    __nxsan_free(pt);
+  }
+
+  EXPECT_TRUE(__nxsan_terminate());
+}
+
+// Granule-sized allocations are not padded with an extra granule.
+TEST(AllocFree, NoPaddingGranule) {
+  if (__nxsan_check_init()) {
+    __nxsan_terminate();
+  }
+  EXPECT_TRUE(__nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE));
+
+  uint8_t* a = (uint8_t*)__nxsan_malloc(__NXSAN_TAG_GRANULARITY_BYTES);
+  uint8_t* b = (uint8_t*)__nxsan_malloc(__NXSAN_TAG_GRANULARITY_BYTES);
+  uint64_t dist = (uint64_t)__NXSAN_REMOVE_TAG(a) > (uint64_t)__NXSAN_REMOVE_TAG(b)
+                      ? (uint64_t)__NXSAN_REMOVE_TAG(a) - (uint64_t)__NXSAN_REMOVE_TAG(b)
+                      : (uint64_t)__NXSAN_REMOVE_TAG(b) - (uint64_t)__NXSAN_REMOVE_TAG(a);
+  EXPECT_EQ(dist, __NXSAN_TAG_GRANULARITY_BYTES);
+  EXPECT_NE(__NXSAN_EXTRACT_TAG(a), __NXSAN_EXTRACT_TAG(b));
+  __nxsan_free(a);
+  __nxsan_free(b);
+
+  EXPECT_TRUE(__nxsan_terminate());
+}
+
+// Attempt to free a pointer part way through an allocation.
+TEST(AllocFree, FreeInterior) {
+  if (__nxsan_check_init()) {
+    __nxsan_terminate();
+  }
+  EXPECT_TRUE(__nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE));
+  uint8_t* pt = (uint8_t*)__nxsan_malloc(__NXSAN_TAG_GRANULARITY_BYTES * 4);
+  ASSERT_DEATH(__nxsan_free(pt + __NXSAN_TAG_GRANULARITY_BYTES), "nxsan-invalid-free");
+  __nxsan_free(pt);
+}
+
+// Check tag clear covers the trailing short granule of multi-granule allocations.
+TEST(AllocFree, TagClearTrailingShortGranule) {
+  if (__nxsan_check_init()) {
+    __nxsan_terminate();
+  }
+  EXPECT_TRUE(__nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE));
+
+  constexpr size_t kSize = __NXSAN_TAG_GRANULARITY_BYTES * 3 + 6;
+  uint8_t* pt = (uint8_t*)__nxsan_malloc(kSize);
+  uint8_t* shadow = __nxsan_get_shadow_address(pt);
+  EXPECT_EQ(shadow[3], 6);
+
+  // Free & check every shadow byte is zeroed.
+  __nxsan_free(pt);
+  for (int i = 0; i < 4; i++) {
+    EXPECT_EQ(shadow[i], 0x0);
+  }
+
+  EXPECT_TRUE(__nxsan_terminate());
+}
+
+// Freed memory is held in quarantine rather than reused immediately.
+TEST(AllocFree, QuarantineDelaysReuse) {
+  if (__nxsan_check_init()) {
+    __nxsan_terminate();
+  }
+  EXPECT_TRUE(__nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE));
+
+  void* freed = __nxsan_malloc(32);
+  __nxsan_free(freed);
+  std::vector<void*> ptrs;
+  for (int i = 0; i < 256; i++) {
+    void* pt = __nxsan_malloc(32);
+    EXPECT_NE(__NXSAN_REMOVE_TAG(pt), __NXSAN_REMOVE_TAG(freed));
+    ptrs.push_back(pt);
+  }
+  for (void* pt : ptrs) {
+    __nxsan_free(pt);
+  }
+
+  EXPECT_TRUE(__nxsan_terminate());
+}
+
+// Chunks larger than the quarantine budget are reused straight away.
+TEST(AllocFree, QuarantineBudget) {
+  if (__nxsan_check_init()) {
+    __nxsan_terminate();
+  }
+  EXPECT_TRUE(__nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE));
+  uint64_t origSize = __nxsan_flags.quarantineSize;
+  __nxsan_flags.quarantineSize = 0;
+
+  void* freed = __nxsan_malloc(32);
+  __nxsan_free(freed);
+  void* pt = __nxsan_malloc(32);
+  EXPECT_EQ(__NXSAN_REMOVE_TAG(pt), __NXSAN_REMOVE_TAG(freed));
+  __nxsan_free(pt);
+
+  __nxsan_flags.quarantineSize = origSize;
+  EXPECT_TRUE(__nxsan_terminate());
+}
+
+// Outstanding allocations are reported as leaks on termination.
+TEST(AllocFree, LeakOnTerminate) {
+  if (__nxsan_check_init()) {
+    __nxsan_terminate();
+  }
+  EXPECT_TRUE(__nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE));
+  ASSERT_DEATH(
+      {
+        __nxsan_malloc(24);
+        __nxsan_malloc(24);
+        __nxsan_free(__nxsan_malloc(64));
+        __nxsan_terminate();
+      },
+      "48 byte\\(s\\) leaked in 2 allocation\\(s\\) \\(nxsan-leak\\)");
+  EXPECT_TRUE(__nxsan_terminate());
+}
+
+// In recover mode, leaks are reported & termination carries on.
+TEST(AllocFree, LeakOnTerminateRecover) {
+  if (__nxsan_check_init()) {
+    __nxsan_terminate();
+  }
+  EXPECT_TRUE(__nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE));
+  __nxsan_set_recover(true);
+
+  __nxsan_malloc(24);
+  __nxsan_malloc(24);
+  testing::internal::CaptureStderr();
+  EXPECT_TRUE(__nxsan_terminate());
+  std::string output = testing::internal::GetCapturedStderr();
+  EXPECT_NE(output.find("48 byte(s) leaked in 2 allocation(s) (nxsan-leak)"), std::string::npos);
+  EXPECT_NE(output.find("=== CONTINUING ==="), std::string::npos);
+  EXPECT_FALSE(__nxsan_check_init());
+
+  __nxsan_set_recover(false);
+}
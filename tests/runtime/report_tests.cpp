@@ -17,8 +17,218 @@ TEST(Reporting, OOB) {
 
   uint8_t* pt = (uint8_t*)__nxsan_malloc(8);
   __nxsan_report_load64(pt);
-  *pt = 4;
+  *(uint8_t*)__NXSAN_REMOVE_TAG(pt) = 4;
   __nxsan_free(pt);
 
   EXPECT_TRUE(__nxsan_terminate());
 }
+
+// Range accesses covering a whole allocation are permitted.
+TEST(Reporting, RangeInBounds) {
+  if (__nxsan_check_init()) {
+    __nxsan_terminate();
+  }
+  EXPECT_TRUE(__nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE));
+
+  uint8_t* pt = (uint8_t*)__nxsan_malloc(__NXSAN_TAG_GRANULARITY_BYTES * 4 + 6);
+  __nxsan_report_load_range(pt, __NXSAN_TAG_GRANULARITY_BYTES * 4 + 6);
+  __nxsan_report_store_range(pt + 3, __NXSAN_TAG_GRANULARITY_BYTES * 2);
+  __nxsan_free(pt);
+
+  EXPECT_TRUE(__nxsan_terminate());
+}
+
+// Vector & arbitrarily sized accesses within an allocation are permitted.
+TEST(Reporting, WideInBounds) {
+  if (__nxsan_check_init()) {
+    __nxsan_terminate();
+  }
+  EXPECT_TRUE(__nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE));
+
+  uint8_t* pt = (uint8_t*)__nxsan_malloc(__NXSAN_TAG_GRANULARITY_BYTES * 4 + 6);
+  __nxsan_report_load128(pt + 8);
+  __nxsan_report_store256(pt + 3);
+  __nxsan_report_load512(pt + 6);
+  __nxsan_report_load_n(pt, __NXSAN_TAG_GRANULARITY_BYTES * 4 + 6);
+  __nxsan_report_store_n(pt + 1, 3);
+  __nxsan_free(pt);
+
+  EXPECT_TRUE(__nxsan_terminate());
+}
+
+// Vector & arbitrarily sized accesses running past an allocation are caught.
+TEST(Reporting, WideOverrun) {
+  if (__nxsan_check_init()) {
+    __nxsan_terminate();
+  }
+  EXPECT_TRUE(__nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE));
+
+  uint8_t* pt = (uint8_t*)__nxsan_malloc(__NXSAN_TAG_GRANULARITY_BYTES * 4 + 6);
+  ASSERT_DEATH(__nxsan_report_load512(pt + 7), "nxsan-heap-buffer-overflow");
+  ASSERT_DEATH(__nxsan_report_store128(pt + __NXSAN_TAG_GRANULARITY_BYTES * 4 - 8), "nxsan-heap-buffer-overflow");
+  ASSERT_DEATH(__nxsan_report_load_n(pt, __NXSAN_TAG_GRANULARITY_BYTES * 4 + 7), "nxsan-heap-buffer-overflow");
+  __nxsan_free(pt);
+}
+
+// Atomic read-modify-writes are verified as a single access.
+TEST(Reporting, AtomicAccesses) {
+  if (__nxsan_check_init()) {
+    __nxsan_terminate();
+  }
+  EXPECT_TRUE(__nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE));
+
+  uint8_t* pt = (uint8_t*)__nxsan_malloc(__NXSAN_TAG_GRANULARITY_BYTES + 8);
+  __nxsan_report_rmw8(pt + 3);
+  __nxsan_report_rmw32(pt + 4);
+  __nxsan_report_rmw64(pt + __NXSAN_TAG_GRANULARITY_BYTES);
+  __nxsan_report_rmw128(pt);
+  ASSERT_DEATH(__nxsan_report_rmw128(pt + 16), "attempted atomic read-modify-write of 16 bytes");
+  ASSERT_DEATH(__nxsan_report_rmw_n(pt + 16, 32), "attempted atomic read-modify-write of 32 bytes");
+  __nxsan_free(pt);
+  ASSERT_DEATH(__nxsan_report_rmw64(pt), "nxsan-use-after-free");
+}
+
+// Range accesses running past the end of a short granule are caught.
+TEST(Reporting, RangeOverrun) {
+  if (__nxsan_check_init()) {
+    __nxsan_terminate();
+  }
+  EXPECT_TRUE(__nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE));
+
+  uint8_t* pt = (uint8_t*)__nxsan_malloc(__NXSAN_TAG_GRANULARITY_BYTES * 4 + 6);
+  ASSERT_DEATH(__nxsan_report_load_range(pt, __NXSAN_TAG_GRANULARITY_BYTES * 4 + 7), "nxsan-heap-buffer-overflow");
+
+  // Ranges starting on the last byte of a short granule, holding its tag.
+  uint8_t* shortPt = (uint8_t*)__nxsan_malloc(__NXSAN_TAG_GRANULARITY_BYTES + 6);
+  ASSERT_DEATH(__nxsan_report_load_range(shortPt + __NXSAN_TAG_GRANULARITY_BYTES * 2 - 1, 2), "nxsan-heap-buffer-overflow");
+  __nxsan_free(shortPt);
+  __nxsan_free(pt);
+}
+
+// Bulk operations within allocations are verified & then performed.
+TEST(Reporting, BulkInBounds) {
+  if (__nxsan_check_init()) {
+    __nxsan_terminate();
+  }
+  EXPECT_TRUE(__nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE));
+
+  size_t size = __NXSAN_TAG_GRANULARITY_BYTES * 4 + 6;
+  uint8_t* src = (uint8_t*)__nxsan_malloc(size);
+  uint8_t* dst = (uint8_t*)__nxsan_malloc(size);
+  EXPECT_EQ(__nxsan_memset(src, 0x5A, size), src);
+  EXPECT_EQ(__nxsan_memcpy(dst, src, size), dst);
+  EXPECT_EQ(__nxsan_memmove(dst + 1, dst, size - 1), dst + 1);
+  EXPECT_EQ(__nxsan_memcpy(dst + size, src, 0), dst + size);
+
+  uint8_t* raw = (uint8_t*)__NXSAN_REMOVE_TAG(dst);
+  for (size_t i = 0; i < size; i++) {
+    EXPECT_EQ(raw[i], 0x5A);
+  }
+  __nxsan_free(src);
+  __nxsan_free(dst);
+
+  EXPECT_TRUE(__nxsan_terminate());
+}
+
+// Bulk operations running past either range, or into freed memory, are caught.
+TEST(Reporting, BulkOverrun) {
+  if (__nxsan_check_init()) {
+    __nxsan_terminate();
+  }
+  EXPECT_TRUE(__nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE));
+
+  size_t size = __NXSAN_TAG_GRANULARITY_BYTES * 4 + 6;
+  uint8_t* small = (uint8_t*)__nxsan_malloc(size);
+  uint8_t* large = (uint8_t*)__nxsan_malloc(size * 2);
+  ASSERT_DEATH(__nxsan_memcpy(small, large, size + 1), "attempted store of [0-9]+ bytes.*nxsan-heap-buffer-overflow");
+  ASSERT_DEATH(__nxsan_memmove(large, small + 1, size), "attempted load of [0-9]+ bytes.*nxsan-heap-buffer-overflow");
+  ASSERT_DEATH(__nxsan_memset(small + 8, 0, size), "nxsan-heap-buffer-overflow");
+  __nxsan_free(small);
+  ASSERT_DEATH(__nxsan_memset(small, 0, 1), "nxsan-use-after-free");
+  __nxsan_free(large);
+}
+
+// Range accesses into freed memory are caught.
+TEST(Reporting, RangeUseAfterFree) {
+  if (__nxsan_check_init()) {
+    __nxsan_terminate();
+  }
+  EXPECT_TRUE(__nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE));
+
+  uint8_t* pt = (uint8_t*)__nxsan_malloc(__NXSAN_TAG_GRANULARITY_BYTES * 4);
+  __nxsan_free(pt);
+  ASSERT_DEATH(__nxsan_report_store_range(pt, __NXSAN_TAG_GRANULARITY_BYTES * 4), "nxsan-use-after-free");
+}
+
+// Reports on freed memory show where it was allocated & freed.
+TEST(Reporting, UseAfterFreeStacks) {
+  if (__nxsan_check_init()) {
+    __nxsan_terminate();
+  }
+  EXPECT_TRUE(__nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE));
+
+  uint8_t* pt = (uint8_t*)__nxsan_malloc(__NXSAN_TAG_GRANULARITY_BYTES * 2);
+  __nxsan_free(pt);
+  ASSERT_DEATH(__nxsan_report_load_range(pt, __NXSAN_TAG_GRANULARITY_BYTES * 2), "freed by:");
+  ASSERT_DEATH(__nxsan_report_load_range(pt, __NXSAN_TAG_GRANULARITY_BYTES * 2), "previously allocated by:");
+}
+
+// Symbolized frames name their module & are stable across lookups.
+TEST(Reporting, SymbolizePc) {
+  void* pc = __builtin_return_address(0);
+  std::string frame = __nxsan_symbolize_pc(pc);
+  EXPECT_NE(frame.find("nxsan-tests"), std::string::npos);
+  EXPECT_EQ(frame, __nxsan_symbolize_pc(pc));
+}
+
+// In recover mode, errors are logged once per PC & execution continues.
+TEST(Reporting, RecoverDeduplicates) {
+  if (__nxsan_check_init()) {
+    __nxsan_terminate();
+  }
+  EXPECT_TRUE(__nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE));
+  __nxsan_set_recover(true);
+
+  uint8_t* pt = (uint8_t*)__nxsan_malloc(__NXSAN_TAG_GRANULARITY_BYTES * 2);
+  __nxsan_free(pt);
+  testing::internal::CaptureStderr();
+  for (int i = 0; i < 100; i++) {
+    __nxsan_report_load_range(pt, __NXSAN_TAG_GRANULARITY_BYTES * 2);
+  }
+  __nxsan_report_store_range(pt, __NXSAN_TAG_GRANULARITY_BYTES * 2);
+  std::string output = testing::internal::GetCapturedStderr();
+
+  // One report from the loop, one from the store.
+  size_t numReports = 0;
+  for (size_t pos = output.find("nxsan-use-after-free"); pos != std::string::npos;
+       pos = output.find("nxsan-use-after-free", pos + 1)) {
+    numReports++;
+  }
+  EXPECT_EQ(numReports, 2u);
+
+  __nxsan_set_recover(false);
+  EXPECT_TRUE(__nxsan_terminate());
+}
+
+// When sampling, only 1 in every N fixed size accesses on a thread is checked.
+TEST(Reporting, SampledAccesses) {
+  if (__nxsan_check_init()) {
+    __nxsan_terminate();
+  }
+  EXPECT_TRUE(__nxsan_init(TRACK_REGION_BASE, TRACK_REGION_SIZE));
+  __nxsan_set_sample_rate(4);
+
+  uint8_t* pt = (uint8_t*)__nxsan_malloc(__NXSAN_TAG_GRANULARITY_BYTES);
+  __nxsan_free(pt);
+
+  // The first access is sampled, the following three are skipped.
+  uint8_t local = 0;
+  __nxsan_report_load8(&local);
+  for (int i = 0; i < 3; i++) {
+    __nxsan_report_load8(pt);
+  }
+  ASSERT_DEATH(__nxsan_report_load8(pt), "nxsan-use-after-free");
+
+  __nxsan_set_sample_rate(1);
+  EXPECT_TRUE(__nxsan_terminate());
+}
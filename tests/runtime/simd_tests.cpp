@@ -0,0 +1,35 @@
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "runtime/nxsan_internal.h"
+
+// Fill exactly the requested range, at every length & alignment around the
+// vector widths.
+TEST(ShadowKernels, Fill) {
+  __nxsan_init_shadow_kernels();
+  for (size_t offset = 0; offset < 32; offset++) {
+    for (size_t len = 0; len < 130; len++) {
+      std::vector<uint8_t> buf(offset + len + 32, 0x0);
+      __nxsan_shadow_fill(buf.data() + offset, 0xAB, len);
+      for (size_t i = 0; i < buf.size(); i++) {
+        bool inRange = i >= offset && i < offset + len;
+        ASSERT_EQ(buf[i], inRange ? 0xAB : 0x0) << "offset " << offset << " len " << len;
+      }
+    }
+  }
+}
+
+// Find the first mismatch at every position within ranges around the vector
+// widths.
+TEST(ShadowKernels, FindMismatch) {
+  __nxsan_init_shadow_kernels();
+  for (size_t len = 0; len < 130; len++) {
+    std::vector<uint8_t> buf(len + 1, 0x7F);
+    EXPECT_EQ(__nxsan_shadow_find_mismatch(buf.data(), 0x7F, len), len);
+    for (size_t pos = 0; pos < len; pos++) {
+      buf[pos] = 0x0;
+      ASSERT_EQ(__nxsan_shadow_find_mismatch(buf.data(), 0x7F, len), pos) << "len " << len;
+      buf[pos] = 0x7F;
+    }
+  }
+}
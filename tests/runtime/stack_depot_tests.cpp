@@ -0,0 +1,58 @@
+#include <gtest/gtest.h>
+
+#include "runtime/nxsan_internal.h"
+
+// Identical stacks are stored once & share an id.
+TEST(StackDepot, Deduplicates) {
+  void* stackA[] = {(void*)0x1000, (void*)0x2000, (void*)0x3000};
+  void* stackB[] = {(void*)0x1000, (void*)0x2000, (void*)0x3000};
+  uint32_t idA = __nxsan_depot_put(stackA, 3);
+  uint32_t idB = __nxsan_depot_put(stackB, 3);
+  EXPECT_NE(idA, 0u);
+  EXPECT_EQ(idA, idB);
+}
+
+// Different stacks (including prefixes of each other) get different ids.
+TEST(StackDepot, DistinctStacks) {
+  void* stack[] = {(void*)0x1100, (void*)0x2200, (void*)0x3300};
+  void* other[] = {(void*)0x1100, (void*)0x2200, (void*)0x3301};
+  uint32_t id = __nxsan_depot_put(stack, 3);
+  EXPECT_NE(id, __nxsan_depot_put(other, 3));
+  EXPECT_NE(id, __nxsan_depot_put(stack, 2));
+}
+
+// Stored stacks can be fetched back by id.
+TEST(StackDepot, RoundTrip) {
+  void* stack[] = {(void*)0xAAAA, (void*)0xBBBB};
+  uint32_t id = __nxsan_depot_put(stack, 2);
+  void* const* pcs;
+  ASSERT_EQ(__nxsan_depot_get(id, &pcs), 2u);
+  EXPECT_EQ(pcs[0], stack[0]);
+  EXPECT_EQ(pcs[1], stack[1]);
+  EXPECT_EQ(__nxsan_depot_get(0, &pcs), 0u);
+}
+
+// Captures a stack from within a known caller.
+static __attribute__((noinline)) uint32_t CaptureFromHelper() {
+  uint32_t id = __nxsan_capture_stack();
+  asm volatile("");
+  return id;
+}
+
+// Captured stacks start at the caller & follow frame pointers up the stack,
+// up to the configured depth.
+TEST(StackDepot, CaptureWalksFramePointers) {
+  uint64_t oldDepth = __nxsan_flags.allocBtDepth;
+  __nxsan_flags.allocBtDepth = 16;
+  void* const* pcs;
+  size_t numPcs = __nxsan_depot_get(CaptureFromHelper(), &pcs);
+  ASSERT_GT(numPcs, 1u);
+  EXPECT_GE(pcs[0], (void*)&CaptureFromHelper);
+  EXPECT_LT(pcs[0], (void*)((uintptr_t)&CaptureFromHelper + 64));
+
+  __nxsan_flags.allocBtDepth = 1;
+  EXPECT_EQ(__nxsan_depot_get(CaptureFromHelper(), &pcs), 1u);
+  __nxsan_flags.allocBtDepth = 0;
+  EXPECT_EQ(CaptureFromHelper(), 0u);
+  __nxsan_flags.allocBtDepth = oldDepth;
+}